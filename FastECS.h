@@ -28,16 +28,45 @@ SOFTWARE.
 #endif
 
 /* Part of the credit goes to Sam Bloomberg and his repo about ECS, available at: https://github.com/redxdev/ECS */
-#include <typeindex>
 #include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <limits>
 #include <unordered_map> 
+#include <map>
+#include <vector>
+#include <new>
 #include <functional>
 #include <type_traits>
 #include <chrono>
+#include <cmath>
+#include <string>
 #include <memory>
+#include <memory_resource>
 #include <stack>
+#include <tuple>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Memory mapped files (snapshots)
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #define USE_OPENGL45
 #include "cppgl/cppgl.hpp"
@@ -60,443 +89,6494 @@ SOFTWARE.
  - BMP loading
  */
 
-#define FCS_COMPONENT(name) private: virtual std::shared_ptr<Component> clone() override { return std::make_shared<name>(*this); }
+// The name identifies the component in snapshots, so it has to be unique among the serialized ones (asserted when saved)
+#define FCS_COMPONENT(name) FCS_COMPONENT_AS(name, #name)
+
+// Same as FCS_COMPONENT with the name given as a constant string, templates need one per instantiation
+#define FCS_COMPONENT_AS(name, label) public: static constexpr const char* ComponentName = label; static inline const bool ComponentRegistered = FCS::detail::registerComponent<name>(); private: static_assert(true, "")
+
+// Same as FCS_COMPONENT but the component is kept in a sparse set pool instead of the entity's archetype
+#define FCS_SPARSE_COMPONENT(name) public: static constexpr FCS::Storage ComponentStorage = FCS::Storage::SparseSet; FCS_COMPONENT(name)
+
+// Phase (FCS::Phase) and priority of a system, systems of a phase run by ascending priority (default Update, 0)
+#define FCS_SYSTEM_ORDER(phase, priority) public: static constexpr FCS::Phase SystemPhase = phase; static constexpr int SystemPriority = priority
 
 #define SYSTEM_NOHANDLE // Makes it so the createSystem does not return a Handle<SystemType>
 
+#ifndef FCS_CHUNK_SIZE
+#define FCS_CHUNK_SIZE (16 * 1024) // Bytes per archetype chunk
+#endif
+
+#ifndef FCS_MAX_COMPONENTS
+#define FCS_MAX_COMPONENTS 64 // Component types supported by signatures (multiple of 64, e.g. 64/128/256)
+#endif
+
+#ifndef FCS_CHUNK_ALIGN
+#define FCS_CHUNK_ALIGN 64 // Chunk alignment, also the max supported component alignment
+#endif
+
+#ifndef FCS_WORKER_THREADS
+#define FCS_WORKER_THREADS 0 // Threads running systems besides the updating one, 0 picks one per extra hardware thread
+#endif
+
+// Define FCS_PROFILING to time systems and events (see Scene::stats), compiled out otherwise
+
+// Define FCS_TRACING to record timed scopes of every thread (see FCS::writeTrace), compiled out otherwise
+#ifdef FCS_TRACING
+#define FCS_TRACE_JOIN_(a, b) a##b
+#define FCS_TRACE_JOIN(a, b) FCS_TRACE_JOIN_(a, b)
+#define FCS_TRACE_SCOPE(name, category) FCS::detail::TraceScope FCS_TRACE_JOIN(fcsTraceScope, __LINE__)(name, category) // Names must outlive the trace
+#else
+#define FCS_TRACE_SCOPE(name, category) (void)0
+#endif
+
+#ifndef FCS_TRACE_CAPACITY
+#define FCS_TRACE_CAPACITY 16384 // Scopes kept per thread with FCS_TRACING, the oldest are overwritten
+#endif
+
+#ifndef FCS_ARENA_PAGE_SIZE
+#define FCS_ARENA_PAGE_SIZE (256 * 1024) // Bytes reserved at a time by the memory of a scene
+#endif
+
 namespace FCS
 {
+	namespace detail
+	{
+		struct ComponentFamily { };
+		struct EventFamily { };
+		struct SystemFamily { };
+		struct QueryFamily { };
+
+		// Hands out dense sequential ids per family, so per type lookups are plain array indexing
+		template<typename Family>
+		inline std::size_t nextTypeId()
+		{
+			static std::atomic<std::size_t> counter(0);
+			return counter++;
+		}
+
+		template<typename Family, typename T>
+		inline std::size_t getTypeId()
+		{
+			static const std::size_t id = nextTypeId<Family>();
+			return id;
+		}
+	}
+
+	// Dense id of a component type, assigned on first use
 	template<typename T>
-	constexpr std::type_index getType()
+	inline std::size_t getComponentId()
 	{
-		return std::type_index(typeid(T));
+		return detail::getTypeId<detail::ComponentFamily, typename std::remove_cv<T>::type>();
 	}
 
+	// Dense id of an event type, assigned on first use
+	template<typename T>
+	inline std::size_t getEventId()
+	{
+		return detail::getTypeId<detail::EventFamily, typename std::remove_cv<T>::type>();
+	}
+
+	// Dense id of a system type, assigned on first use
+	template<typename T>
+	inline std::size_t getSystemId()
+	{
+		return detail::getTypeId<detail::SystemFamily, typename std::remove_cv<T>::type>();
+	}
+
+	// Components are plain values stored by their archetype, so no virtual interface is required
 	class Component
 	{
 	public:
 		friend class Entity;
-		virtual ~Component() { }
 
 	protected:
-		Component() { }
+		Component() = default;
+		~Component() = default;
+	};
 
-	private:
-		virtual std::shared_ptr<Component> clone() = 0;
+	namespace detail
+	{
+		static_assert(FCS_MAX_COMPONENTS % 64 == 0, "FCS_MAX_COMPONENTS must be a multiple of 64.");
 
-	private:
-		bool isActive = true;
-	};
+		// Set of component ids, one bit per component type
+		struct Signature
+		{
+			static constexpr std::size_t words = FCS_MAX_COMPONENTS / 64;
 
-	class Scene;
+			std::uint64_t bits[words] = { };
 
-	template<typename... U>
-	class System;
+			inline void set(std::size_t id)
+			{
+				assert(id < FCS_MAX_COMPONENTS && "Too many component types, increase FCS_MAX_COMPONENTS.");
+				bits[id / 64] |= std::uint64_t(1) << (id % 64);
+			}
 
-	// TODO: Threadable
-	class Subscriber
+			inline void reset(std::size_t id)
+			{
+				bits[id / 64] &= ~(std::uint64_t(1) << (id % 64));
+			}
+
+			inline bool test(std::size_t id) const
+			{
+				return (bits[id / 64] >> (id % 64)) & 1;
+			}
+
+			// Checks all the bits of mask are set, branchless so it vectorizes over the words
+			inline bool contains(const Signature& mask) const
+			{
+				std::uint64_t missing = 0;
+				for (std::size_t w = 0; w < words; w++)
+				{
+					missing |= mask.bits[w] & ~bits[w];
+				}
+				return missing == 0;
+			}
+
+			// Checks if any bit is set in both
+			inline bool intersects(const Signature& other) const
+			{
+				std::uint64_t shared = 0;
+				for (std::size_t w = 0; w < words; w++)
+				{
+					shared |= other.bits[w] & bits[w];
+				}
+				return shared != 0;
+			}
+
+			inline bool operator==(const Signature& other) const
+			{
+				return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+			}
+
+			inline bool operator<(const Signature& other) const
+			{
+				return std::lexicographical_compare(bits, bits + words, other.bits, other.bits + words);
+			}
+		};
+
+		// Mask of a component set, built once per query type
+		template<typename... Types>
+		inline const Signature& signatureOf()
+		{
+			static const Signature mask = []()
+			{
+				Signature s;
+				(s.set(getComponentId<Types>()), ...);
+				return s;
+			}();
+			return mask;
+		}
+	}
+
+	// Where the components of a type are stored
+	// Archetype: packed with the other components of the entity, fastest iteration
+	// SparseSet: own pool per type, O(1) add/remove for components that churn often
+	enum class Storage
 	{
-	public:
-		virtual ~Subscriber() { }
+		Archetype,
+		SparseSet
 	};
 
-	template<typename Evt>
-	class EventSubscriber : public Subscriber
+	// Identifies an entity inside its scene
+	// The generation is bumped when the entity is destroyed, so stale ids are detected once the slot is recycled
+	struct EntityId
+	{
+		std::uint32_t index = 0;
+		std::uint32_t generation = 0; // Never issued, a default constructed id is null
+
+		inline bool isNull() const { return generation == 0; }
+
+		inline bool operator==(const EntityId& other) const { return index == other.index && generation == other.generation; }
+		inline bool operator!=(const EntityId& other) const { return !(*this == other); }
+	};
+
+	static_assert(sizeof(EntityId) == 8 && std::is_trivially_copyable<EntityId>::value, "EntityId must be a trivially copyable 8 byte value.");
+
+	// Non owning view over contiguous values (std::span is C++20)
+	template<typename T>
+	class Span
 	{
 	public:
-		template<typename... U>
-		friend class System;
-		friend class Scene;
-		virtual ~EventSubscriber() { }
+		Span() = default;
+		Span(T* data, std::size_t size) : pointer(data), count(size) { }
 
-	protected:
-		virtual void onEvent(Scene* scene, const Evt& event) = 0;
+		template<typename U, typename = std::enable_if_t<std::is_same<std::remove_const_t<T>, U>::value>>
+		Span(const std::vector<U>& values) : pointer(values.data()), count(values.size()) { }
+
+		inline T* data() const { return pointer; }
+		inline std::size_t size() const { return count; }
+		inline bool empty() const { return count == 0; }
+
+		inline T& operator[](std::size_t i) const { return pointer[i]; }
+		inline T* begin() const { return pointer; }
+		inline T* end() const { return pointer + count; }
 
 	private:
-		inline void subscribe(Scene* scene);
-		inline void unsubscribe(Scene* scene);
+		T* pointer = nullptr;
+		std::size_t count = 0;
 	};
 
-	class BaseSystem
+	class Entity;
+
+	// Bytes held by the memory of a scene
+	struct MemoryStats
 	{
-	public:
-		virtual ~BaseSystem() { }
+		std::size_t reserved = 0; // Taken from the global heap
+		std::size_t used = 0; // Handed out to the scene, rounded up to the size classes
+	};
 
-		virtual void initialize(Scene* scene) = 0;
-		virtual void deinitialize(Scene* scene) = 0;
-		virtual void update(Scene* scene, float deltaTime) = 0;
+	// Summary of the last samples of a timing, in seconds
+	struct TimingStats
+	{
+		std::size_t samples = 0;
+		double p50 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
 
-	protected:
-		std::unordered_map<std::type_index, std::vector<std::weak_ptr<Component>>> specificComponents; //TODO: This will be targeted later
-		bool isActive = true;
+	struct SystemStats
+	{
+		std::string name;
+		std::size_t calls = 0;
+		std::size_t entities = 0; // Visited by the last update through each/parallelEach/view
+		std::size_t totalEntities = 0;
+		double totalTime = 0.0;
+		TimingStats time;
 	};
 
-	template<typename... Events>
-	class System : public BaseSystem, public EventSubscriber<Events>...
+	struct EventStats
 	{
-	public:
-		friend class Scene;
-		virtual ~System() { }
-		
-	private:
-		inline void internal_initialize(Scene* scene);
-		inline void internal_deinitialize(Scene* scene);
+		std::string name;
+		std::size_t dispatches = 0;
+		double totalTime = 0.0;
+		TimingStats time;
+	};
 
-	public:
-		System() { }
+	// Snapshot of a scene (see Scene::stats), systems and events are only filled with FCS_PROFILING
+	struct SceneStats
+	{
+		std::size_t entities = 0;
+		MemoryStats memory;
+		std::vector<SystemStats> systems; // In schedule order
+		std::vector<EventStats> events; // By event id, the ones emitted at least once
+	};
 
-	private:
-		template <typename U>
-		void call_subscribe(Scene* scene)
+	namespace detail
+	{
+		// Cuts the type out of the signature of typeName<T>, dropping the class/struct keyword
+		inline std::string parseTypeName(const std::string& signature)
 		{
-			FCS::EventSubscriber<U>::subscribe(scene);
+#ifdef _MSC_VER
+			std::size_t begin = signature.find("typeName<") + 9;
+			std::size_t end = signature.rfind(">(void)");
+#else
+			std::size_t begin = signature.find("T = ") + 4;
+			std::size_t end = signature.find_first_of(";]", begin);
+#endif
+			std::string result = signature.substr(begin, end - begin);
+			for (const char* prefix : { "class ", "struct " })
+			{
+				if (result.compare(0, std::strlen(prefix), prefix) == 0)
+				{
+					result.erase(0, std::strlen(prefix));
+				}
+			}
+			return result;
 		}
 
-		template <typename U>
-		void call_unsubscribe(Scene* scene)
+		// Readable name of a type without RTTI
+		template<typename T>
+		inline const std::string& typeName()
 		{
-			FCS::EventSubscriber<U>::unsubscribe(scene);
+#ifdef _MSC_VER
+			static const std::string name = parseTypeName(__FUNCSIG__);
+#else
+			static const std::string name = parseTypeName(__PRETTY_FUNCTION__);
+#endif
+			return name;
 		}
 
-		template <typename U, typename... Us>
-		inline typename std::enable_if< (sizeof...(Us) > 0) >::type call_subscribe(Scene* scene)
+		// Rolling window over the last samples, percentiles are only computed for a snapshot
+		class Histogram
 		{
-			FCS::EventSubscriber<U>::subscribe(scene);
-			call_subscribe<Us...>(scene);
-		}
+		public:
+			static constexpr std::size_t window = 256;
+
+			inline void add(double sample)
+			{
+				samples[next % window] = sample;
+				next++;
+			}
+
+			inline TimingStats summary() const
+			{
+				TimingStats stats;
+				std::size_t count = std::min(next, window);
+				if (count == 0)
+				{
+					return stats;
+				}
+
+				std::vector<double> sorted(samples, samples + count);
+				std::sort(sorted.begin(), sorted.end());
+				stats.samples = count;
+				stats.p50 = sorted[(count - 1) / 2];
+				stats.p99 = sorted[(count - 1) * 99 / 100];
+				stats.max = sorted.back();
+				return stats;
+			}
+
+			// Adds the samples kept by another window, oldest first
+			inline void merge(const Histogram& other)
+			{
+				for (std::size_t i = other.next - std::min(other.next, window); i < other.next; i++)
+				{
+					add(other.samples[i % window]);
+				}
+			}
+
+		private:
+			double samples[window] = { };
+			std::size_t next = 0;
+		};
 
-		template <typename U, typename... Us>
-		inline typename std::enable_if< (sizeof...(Us) > 0) >::type call_unsubscribe(Scene* scene)
+		struct Profile
 		{
-			FCS::EventSubscriber<U>::unsubscribe(scene);
-			call_unsubscribe<Us...>(scene);
-		}
-	};
+			std::string name;
+			std::size_t calls = 0;
+			double total = 0.0;
+			Histogram time;
 
-	template<typename T>
-	class Handle
-	{
-	public:
-		friend class Scene;
-		Handle() { data = std::weak_ptr<T>(); }
-		Handle(const Handle<T>& other) { data = other.data; }
-		Handle(std::weak_ptr<T> data) { this->data = data; }
-		~Handle() = default;
+			inline void record(double seconds)
+			{
+				calls++;
+				total += seconds;
+				time.add(seconds);
+			}
+		};
 
-	public:
-		T* operator->() const
+		struct SystemProfile : Profile
 		{
-			return data.lock().get();
-		}
+			std::size_t entities = 0;
+			std::size_t totalEntities = 0;
+		};
 
-		// Checks if the rvalue inside the handle is valid
-		inline bool expired()
+		// Counter of the system updating on this thread, if any
+		inline std::size_t*& entityCounter()
 		{
-			return data.expired();
+			static thread_local std::size_t* counter = nullptr;
+			return counter;
 		}
 
-	private:
-		std::weak_ptr<T> data;
-	};
-
-	class Entity
-	{
-	public: //TODO: This should be removed from public access
-		Entity() { }
-		Entity(const Entity& other)
+		// Adds entities visited by the iteration helpers to the running system, nothing without FCS_PROFILING
+		inline void countEntities(std::size_t count)
 		{
-			for (auto oc : other.components)
+#ifdef FCS_PROFILING
+			if (std::size_t* counter = entityCounter())
 			{
-				components.insert({ oc.first, oc.second->clone() });
+				*counter += count;
 			}
+#else
+			(void)count;
+#endif
 		}
 
-	public:
-		// Add a component of type to the entity
-		template<typename T>
-		inline Handle<T> addComponent();
-
-		// Remove a comnponent of type from the entity
-		template<typename T>
-		inline void removeComponent();
-
-		// Get a component of type in the entity
-		template<typename T>
-		inline Handle<T> getComponent();
+		// Times a system update and collects the entities it visits on this thread
+		class SystemScope
+		{
+		public:
+			inline explicit SystemScope(SystemProfile& profile) : profile(profile), previous(entityCounter()), start(std::chrono::steady_clock::now())
+			{
+				entityCounter() = &entities;
+			}
 
-		// Check entity has a type of component
-		template<typename T>
-		inline bool has();
+			inline ~SystemScope()
+			{
+				profile.record(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+				profile.entities = entities;
+				profile.totalEntities += entities;
+				entityCounter() = previous;
+			}
 
-		// Check entity has all types of components
-		template<typename T, typename U, typename... Args>
-		inline bool has();
+			SystemScope(const SystemScope&) = delete;
+			SystemScope& operator=(const SystemScope&) = delete;
 
-	private:
-		std::unordered_map<std::type_index, std::shared_ptr<Component>> components;
-		bool isActive = true;
-	};
+		private:
+			SystemProfile& profile;
+			std::size_t* previous; // Nested updates (helping a parallel loop) restore it
+			std::size_t entities = 0;
+			std::chrono::steady_clock::time_point start;
+		};
 
-	namespace Event
-	{
-		struct EntityCreated
+#ifdef FCS_TRACING
+		// Scope that ended, times in nanoseconds since the tracer started
+		struct TraceEvent
 		{
-			Handle<Entity> entity;
+			const char* name;
+			const char* category;
+			std::int64_t begin;
+			std::int64_t end;
 		};
 
-		struct EntityDestroyed
+		// Ring of the last scopes of a thread, only its thread writes to it
+		struct TraceBuffer
 		{
-			Handle<Entity> entity;
-		};
-	}
+			inline TraceBuffer(std::size_t thread) : thread(thread), events(new TraceEvent[FCS_TRACE_CAPACITY]) { }
 
-	class SceneManager;
+			inline void push(const TraceEvent& event)
+			{
+				std::size_t count = written.load(std::memory_order_relaxed);
+				events[count % FCS_TRACE_CAPACITY] = event;
+				written.store(count + 1, std::memory_order_release);
+			}
 
-	class Scene
-	{
-	public:
-		template<typename U>
-		friend class EventSubscriber;
-		friend class SceneManager;
+			std::size_t thread;
+			std::string name;
+			std::unique_ptr<TraceEvent[]> events;
+			std::atomic<std::size_t> written { 0 };
+			std::atomic<std::size_t> cleared { 0 }; // Events before this one were dropped by clear
+		};
 
-	protected:
-		// User code to initialize the scene
-		inline virtual void initialize() = 0;
+		// Owns the buffers of every thread that ever traced, so scopes of finished threads still get written
+		class Tracer
+		{
+		public:
+			// Never destroyed, threads may still trace while statics go away
+			static inline Tracer& instance()
+			{
+				static Tracer* tracer = new Tracer();
+				return *tracer;
+			}
 
-		// User code to clean the scene
-		inline virtual void deinitialize() = 0;
+			inline TraceBuffer& local()
+			{
+				static thread_local TraceBuffer* buffer = nullptr;
+				if (!buffer)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					buffers.push_back(std::make_unique<TraceBuffer>(buffers.size()));
+					buffer = buffers.back().get();
+				}
+				return *buffer;
+			}
 
-	public:
-		// Instantiates a entity on the scene
-		inline Handle<Entity> instantiate(Handle<Entity> copy = Handle<Entity>());
+			inline std::int64_t now() const
+			{
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+			}
 
-		// Destroys an entity on the scene
-		inline void destroy(Handle<Entity> value);
+			// Shown instead of the thread number in trace viewers
+			inline void nameThread(const std::string& name)
+			{
+				TraceBuffer& buffer = local();
+				std::lock_guard<std::mutex> lock(mutex);
+				buffer.name = name;
+			}
 
-		// Get all entities on the scene
-		inline std::vector<Handle<Entity>> getAll();
+			inline bool write(const char* path);
 
-		// Get all the entities that have all selected types in the scene
-		template<typename... Types>
-		inline std::vector<Handle<Entity>> getAllWith();
+			inline void clear()
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (auto& buffer : buffers)
+				{
+					buffer->cleared.store(buffer->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+				}
+			}
 
-#ifndef SYSTEM_NOHANDLE
-		// Create a system in the scene
-		template<typename System>
-		inline Handle<System> createSystem();
+		private:
+			Tracer() : epoch(std::chrono::steady_clock::now()) { }
+
+			static inline void writeString(std::FILE* file, const char* string)
+			{
+				std::fputc('"', file);
+				for (; *string; string++)
+				{
+					if (*string == '"' || *string == '\\')
+					{
+						std::fputc('\\', file);
+					}
+					std::fputc(*string, file);
+				}
+				std::fputc('"', file);
+			}
+
+		private:
+			std::mutex mutex;
+			std::vector<std::unique_ptr<TraceBuffer>> buffers;
+			std::chrono::steady_clock::time_point epoch;
+		};
+
+		// Chrome trace_event JSON, every scope as a complete event on the row of its thread
+		inline bool Tracer::write(const char* path)
+		{
+			std::FILE* file = std::fopen(path, "wb");
+			if (!file)
+			{
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+			bool first = true;
+			for (auto& buffer : buffers)
+			{
+				std::string name = buffer->name.empty() ? "Thread " + std::to_string(buffer->thread) : buffer->name;
+				std::fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":", first ? "" : ",", buffer->thread);
+				writeString(file, name.c_str());
+				std::fputs("}}", file);
+				first = false;
+
+				std::size_t end = buffer->written.load(std::memory_order_acquire);
+				std::size_t begin = std::max(buffer->cleared.load(std::memory_order_relaxed), end > FCS_TRACE_CAPACITY ? end - FCS_TRACE_CAPACITY : std::size_t(0));
+				for (std::size_t i = begin; i < end; i++)
+				{
+					const TraceEvent& event = buffer->events[i % FCS_TRACE_CAPACITY];
+					std::fputs(",\n{\"name\":", file);
+					writeString(file, event.name);
+					std::fputs(",\"cat\":", file);
+					writeString(file, event.category);
+					std::fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}", buffer->thread, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+				}
+			}
+			std::fputs("\n]}\n", file);
+			return std::fclose(file) == 0;
+		}
+
+		// Records the time between its construction and destruction, see FCS_TRACE_SCOPE
+		class TraceScope
+		{
+		public:
+			inline TraceScope(const char* name, const char* category) : name(name), category(category), begin(Tracer::instance().now()) { }
+
+			inline ~TraceScope()
+			{
+				Tracer& tracer = Tracer::instance();
+				tracer.local().push({ name, category, begin, tracer.now() });
+			}
+
+			TraceScope(const TraceScope&) = delete;
+			TraceScope& operator=(const TraceScope&) = delete;
+
+		private:
+			const char* name;
+			const char* category;
+			std::int64_t begin;
+		};
+#endif
+	}
+
+	// Writes the scopes recorded by every thread as Chrome trace_event JSON (chrome://tracing, Perfetto)
+	// Call it between updates, scopes running meanwhile may show up torn. False without FCS_TRACING
+	inline bool writeTrace(const char* path)
+	{
+#ifdef FCS_TRACING
+		return detail::Tracer::instance().write(path);
 #else
-		// Create a system in the scene
-		template<typename System>
-		inline void createSystem();
+		(void)path;
+		return false;
 #endif
-		// Remove a system from the scene
-		template<typename System>
-		inline void deleteSystem();
+	}
+
+	// Drops the scopes recorded so far
+	inline void clearTrace()
+	{
+#ifdef FCS_TRACING
+		detail::Tracer::instance().clear();
+#endif
+	}
+
+	// Bytes of a snapshot being written, see ComponentSerializer
+	class SnapshotWriter
+	{
+	public:
+		inline void write(const void* data, std::size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			buffer.insert(buffer.end(), bytes, bytes + size);
+		}
 
-		// Emit an event to all active subscribers
 		template<typename T>
-		inline void emit(const T& event);
+		inline void write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written as bytes.");
+			write(&value, sizeof(T));
+		}
 
-	private:
-		inline void internal_update(float deltaTime);
+		inline void writeString(const std::string& value)
+		{
+			write(static_cast<std::uint32_t>(value.size()));
+			write(value.data(), value.size());
+		}
 
-	public:
-		Scene() { }
+		// 7 bits per byte, small values take a single one
+		inline void writeVarint(std::uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				buffer.push_back(static_cast<unsigned char>(value | 0x80));
+				value >>= 7;
+			}
+			buffer.push_back(static_cast<unsigned char>(value));
+		}
+
+		inline const std::vector<unsigned char>& bytes() const { return buffer; }
+		inline void clear() { buffer.clear(); }
 
 	private:
-		std::vector<std::shared_ptr<Entity>> entities;
-		std::unordered_map<std::type_index, std::shared_ptr<BaseSystem>> systems;
-		std::unordered_map<std::type_index, std::vector<Subscriber*>> subscribers;
+		std::vector<unsigned char> buffer;
 	};
 
-	//TODO: Extend states system (?)
-
-	class SceneManager
+	// Bounds checked reads over the bytes of a snapshot, past the end nothing is read and failed() turns true
+	class SnapshotReader
 	{
-	private:
-		inline void update();
-
 	public:
-		// Loads the selected scene on top of the stack
-		template<typename Scene>
-		static void LoadScene(bool unloadLast = false);
+		SnapshotReader(const void* data, std::size_t size) : cursor(static_cast<const unsigned char*>(data)), end(cursor + size) { }
 
-		// Unloads last scene (top of stack)
-		static void UnloadScene();
+		// Next size bytes, nullptr if there are not enough
+		inline const unsigned char* skip(std::size_t size)
+		{
+			if (failure || size > static_cast<std::size_t>(end - cursor))
+			{
+				failure = true;
+				return nullptr;
+			}
+			const unsigned char* bytes = cursor;
+			cursor += size;
+			return bytes;
+		}
 
-		// Get all scenes in the stack
-		static std::size_t GetSceneCount();
+		inline bool read(void* data, std::size_t size)
+		{
+			const unsigned char* bytes = skip(size);
+			if (bytes && size > 0)
+			{
+				std::memcpy(data, bytes, size);
+			}
+			return bytes != nullptr;
+		}
 
-	private:
-		static inline SceneManager& Instance()
+		template<typename T>
+		inline T read()
 		{
-			static SceneManager instance;
-			return instance;
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read as bytes.");
+			T value { };
+			read(&value, sizeof(T));
+			return value;
 		}
 
-	private:
-		SceneManager() = default;
+		inline std::string readString()
+		{
+			std::uint32_t size = read<std::uint32_t>();
+			const unsigned char* bytes = skip(size);
+			return bytes ? std::string(reinterpret_cast<const char*>(bytes), size) : std::string();
+		}
+
+		inline std::uint64_t readVarint()
+		{
+			std::uint64_t value = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7)
+			{
+				const unsigned char* byte = skip(1);
+				if (!byte)
+				{
+					return 0;
+				}
+
+				value |= std::uint64_t(*byte & 0x7F) << shift;
+				if (!(*byte & 0x80))
+				{
+					return value;
+				}
+			}
+			failure = true;
+			return 0;
+		}
+
+		inline std::size_t remaining() const { return end - cursor; }
+		inline bool failed() const { return failure; }
 
 	private:
-		std::stack<std::unique_ptr<Scene>> scenes;
+		const unsigned char* cursor;
+		const unsigned char* end;
+		bool failure = false;
 	};
 
-	inline void Scene::internal_update(float deltaTime)
+	// Snapshot serialization of a component type (see Scene::saveSnapshot)
+	// Trivially copyable components are copied as raw blocks, specialize this for the others (or to override that):
+	//     static void save(SnapshotWriter& writer, const T& value);
+	//     static void load(SnapshotReader& reader, T& value); // value is default constructed
+	template<typename T>
+	struct ComponentSerializer { };
+
+	namespace detail
 	{
-		for (auto tsp : systems)
+		class BasePool;
+
+		// Type erased lifecycle of a component type, allowing archetype columns to hold any component
+		struct ComponentInfo
+		{
+			std::size_t id;
+			std::size_t size;
+			std::size_t align;
+			void (*construct)(void* dst);
+			void (*copy)(void* dst, const void* src);
+			void (*relocate)(void* dst, void* src); // Moves src into dst and destroys src
+			void (*assign)(void* dst, void* src); // Move assigns src into dst and destroys src
+			void (*destroy)(void* ptr);
+			std::unique_ptr<BasePool> (*makePool)(std::pmr::memory_resource* memory); // Sparse set components only, nullptr otherwise
+			bool trivialDestroy; // Destroy can be skipped when releasing rows in bulk
+			bool trivialCopy; // Copy can be done as bytes
+			const char* name; // ComponentName, nullptr if the type has none
+			bool raw; // Snapshots copy the values as bytes
+			void (*save)(SnapshotWriter& writer, const void* src); // From ComponentSerializer, nullptr if not specialized
+			void (*load)(SnapshotReader& reader, void* dst);
+		};
+
+		template<typename T>
+		inline const ComponentInfo* getComponentInfo();
+
+		// Component types by name, so snapshots can be loaded before the types are used
+		// Names shared by several types map to nullptr, those can't be told apart in a snapshot
+		inline std::unordered_map<std::string, const ComponentInfo*>& componentRegistry()
+		{
+			static std::unordered_map<std::string, const ComponentInfo*> registry;
+			return registry;
+		}
+
+		inline bool registerComponentInfo(const ComponentInfo* info)
+		{
+			if (info->name)
+			{
+				auto inserted = componentRegistry().emplace(info->name, info);
+				if (!inserted.second && inserted.first->second != info)
+				{
+					inserted.first->second = nullptr;
+				}
+			}
+			return true;
+		}
+
+		// Run by FCS_COMPONENT when the program starts
+		template<typename T>
+		inline bool registerComponent()
+		{
+			getComponentInfo<T>();
+			return true;
+		}
+
+		// Read only view of a whole file mapped into memory
+		class MappedFile
+		{
+		public:
+			// Copy on write mappings can be written to, changes stay private to the process
+			inline explicit MappedFile(const char* path, bool copyOnWrite = false);
+			inline ~MappedFile();
+
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+		public:
+			inline const unsigned char* data() const { return bytes; }
+			inline std::size_t size() const { return length; }
+
+			// False if the file could not be opened, empty files are valid with no data
+			inline bool valid() const { return opened; }
+
+		private:
+			const unsigned char* bytes = nullptr;
+			std::size_t length = 0;
+			bool opened = false;
+#ifdef _WIN32
+			HANDLE mapping = nullptr;
+#endif
+		};
+
+#ifdef _WIN32
+		inline MappedFile::MappedFile(const char* path, bool copyOnWrite)
+		{
+			HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				return;
+			}
+
+			LARGE_INTEGER size;
+			opened = GetFileSizeEx(file, &size) != 0;
+			if (opened && size.QuadPart > 0)
+			{
+				// The mapping keeps the file open
+				mapping = CreateFileMappingA(file, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+				void* view = mapping ? MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0) : nullptr;
+				opened = view != nullptr;
+				bytes = static_cast<const unsigned char*>(view);
+				length = view ? static_cast<std::size_t>(size.QuadPart) : 0;
+			}
+			CloseHandle(file);
+		}
+
+		inline MappedFile::~MappedFile()
+		{
+			if (bytes)
+			{
+				UnmapViewOfFile(bytes);
+			}
+
+			if (mapping)
+			{
+				CloseHandle(mapping);
+			}
+		}
+#else
+		inline MappedFile::MappedFile(const char* path, bool copyOnWrite)
+		{
+			int file = ::open(path, O_RDONLY);
+			if (file < 0)
+			{
+				return;
+			}
+
+			struct stat info;
+			opened = ::fstat(file, &info) == 0;
+			if (opened && info.st_size > 0)
+			{
+				// The mapping keeps the file open
+				void* view = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, file, 0);
+				opened = view != MAP_FAILED;
+				if (opened)
+				{
+					::madvise(view, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+					bytes = static_cast<const unsigned char*>(view);
+					length = static_cast<std::size_t>(info.st_size);
+				}
+			}
+			::close(file);
+		}
+
+		inline MappedFile::~MappedFile()
+		{
+			if (bytes)
+			{
+				::munmap(const_cast<unsigned char*>(bytes), length);
+			}
+		}
+#endif
+
+		// Memory owned by a scene, everything goes back to the global heap at once when the scene is gone
+		// Small blocks come from power of two size classes whose free lists are carved from a bump arena of pages
+		// Blocks over the largest class go straight to the global heap. Not thread safe, like structural changes
+		class SceneMemory : public std::pmr::memory_resource
+		{
+		public:
+			static constexpr std::size_t minClass = 16;
+			static constexpr std::size_t classCount = 13; // 16 B up to 64 KB
+			static constexpr std::size_t slabSize = 16 * 1024; // Bytes carved at a time to refill a size class
+
+			static_assert((minClass << (classCount - 1)) <= FCS_ARENA_PAGE_SIZE, "FCS_ARENA_PAGE_SIZE must fit the largest size class.");
+
+			SceneMemory() = default;
+			~SceneMemory() { release(); }
+
+			SceneMemory(const SceneMemory&) = delete;
+			SceneMemory& operator=(const SceneMemory&) = delete;
+
+		public:
+			inline MemoryStats stats() const { return { reserved, used }; }
+
+			// Frees all the pages and large blocks, anything handed out before is left dangling
+			inline void release();
+
+		private:
+			inline void* do_allocate(std::size_t bytes, std::size_t align) override;
+			inline void do_deallocate(void* ptr, std::size_t bytes, std::size_t align) override;
+			inline bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+			// Size class index of a block or classCount if too large
+			static inline std::size_t sizeClass(std::size_t bytes, std::size_t align);
+
+			// Takes bytes from the current page, reserving a new one if needed
+			inline unsigned char* bump(std::size_t bytes);
+
+		private:
+			struct FreeBlock
+			{
+				FreeBlock* next;
+			};
+
+			FreeBlock* freeLists[classCount] = { };
+			std::vector<unsigned char*> pages;
+			std::size_t pageOffset = FCS_ARENA_PAGE_SIZE; // First free byte of the last page
+			std::unordered_map<void*, std::size_t> large; // Alignment of the blocks taken from the global heap
+			std::size_t reserved = 0;
+			std::size_t used = 0;
+		};
+
+		// Destroys the first rows of every column of a chunk with the given layout
+		inline void destroyRows(const std::vector<const ComponentInfo*>& components, const std::vector<std::size_t>& offsets, unsigned char* chunk, std::size_t rows)
+		{
+			for (std::size_t c = 0; c < components.size(); c++)
+			{
+				if (!components[c]->trivialDestroy)
+				{
+					for (std::size_t row = 0; row < rows; row++)
+					{
+						components[c]->destroy(chunk + offsets[c] + row * components[c]->size);
+					}
+				}
+			}
+		}
+
+		// Copy of the chunks of an archetype with the same layout (see Scene::saveState)
+		struct ArchetypeImage
+		{
+			ArchetypeImage() = default;
+			inline ~ArchetypeImage();
+
+			ArchetypeImage(const ArchetypeImage&) = delete;
+			ArchetypeImage& operator=(const ArchetypeImage&) = delete;
+
+			inline std::size_t chunkRows(std::size_t chunk) const
+			{
+				return rows > chunk * capacity ? std::min(capacity, rows - chunk * capacity) : 0;
+			}
+
+			std::size_t rows = 0;
+			std::vector<unsigned char*> chunks; // Kept when the archetype shrinks, the ones past the rows hold no values
+			std::vector<std::uint64_t> versions; // Stamp of the archetype chunk when copied, chunks with the same one hold the same rows
+			std::vector<const ComponentInfo*> components; // Layout of the archetype, so the values can be destroyed without it
+			std::vector<std::size_t> offsets;
+			std::size_t capacity = 0;
+			std::size_t chunkBytes = 0;
+		};
+
+		inline ArchetypeImage::~ArchetypeImage()
+		{
+			for (std::size_t chunk = 0; chunk < chunks.size(); chunk++)
+			{
+				destroyRows(components, offsets, chunks[chunk], chunkRows(chunk));
+				::operator delete(chunks[chunk], std::align_val_t(FCS_CHUNK_ALIGN));
+			}
+		}
+
+		// Entities sharing the same set of components live here
+		// Each chunk holds 'capacity' rows laid out as one contiguous array per component (SoA)
+		// All chunks are full except the last one, so row r lives in chunk r / capacity
+		class Archetype
+		{
+		public:
+			static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+			inline Archetype(std::vector<const ComponentInfo*> infos, std::pmr::memory_resource* memory, const std::uint64_t* clock);
+			inline ~Archetype();
+
+			Archetype(const Archetype&) = delete;
+			Archetype& operator=(const Archetype&) = delete;
+
+		public:
+			// Column of the component id or npos if not present
+			inline std::size_t column(std::size_t id) const
+			{
+				return id < columns.size() ? columns[id] : npos;
+			}
+
+			// Check archetype has all the component types
+			template<typename... Types>
+			inline bool has() const;
+
+			inline void* get(std::size_t column, std::size_t row) const
+			{
+				return chunks[row / capacity] + offsets[column] + (row % capacity) * components[column]->size;
+			}
+
+			inline EntityId& entity(std::size_t row) const
+			{
+				return reinterpret_cast<EntityId*>(chunks[row / capacity])[row % capacity];
+			}
+
+			// Reserves a row for the entity (components are left unconstructed)
+			inline std::uint32_t allocate(EntityId entity);
+
+			// Frees a row whose components were already destroyed or relocated
+			// The last row is moved into the hole, returns the entity that moved (null if none)
+			inline EntityId remove(std::size_t row);
+
+			// Destroys every row and releases all the chunks
+			inline void clear();
+
+			inline std::size_t size() const { return count; }
+
+			// Direct chunk access for iteration, every chunk holds at least one row
+			inline std::size_t chunkCount() const { return chunks.size(); }
+			inline std::size_t chunkRows(std::size_t chunk) const { return std::min(capacity, count - chunk * capacity); }
+			inline EntityId* chunkEntities(std::size_t chunk) const { return reinterpret_cast<EntityId*>(chunks[chunk]); }
+			inline void* chunkColumn(std::size_t chunk, std::size_t column) const { return chunks[chunk] + offsets[column]; }
+
+			// Copies count values as bytes into the column from row on, across chunks (trivially copyable components only)
+			inline void writeRaw(std::size_t column, std::size_t row, const unsigned char* values, std::size_t count);
+
+			// Stamps chunks as written at the current state clock, whoever hands out mutable rows calls these
+			// Systems of the same batch can touch a chunk at once, the stamps are atomic for that
+			inline void touch(std::size_t chunk) const { stamps[chunk].store(*clock, std::memory_order_relaxed); }
+			inline void touchRow(std::size_t row) const { touch(row / capacity); }
+			inline void touchAll() const
+			{
+				for (std::size_t chunk = 0; chunk < chunks.size(); chunk++)
+				{
+					touch(chunk);
+				}
+			}
+
+			// Copies the chunks stamped after 'since' (or missing) into the image and the other way around
+			inline void saveChunks(ArchetypeImage& image, std::uint64_t since) const;
+			inline void restoreChunks(const ArchetypeImage& image, std::uint64_t since);
+
+		public:
+			std::vector<const ComponentInfo*> components; // Sorted by id
+			Signature signature;
+			std::vector<Archetype*> addEdges; // By component id
+			std::vector<Archetype*> removeEdges; // By component id
+			std::uint64_t revision = 0; // State clock of the last row added or removed
+			std::size_t index = 0; // Position in the scene archetypes (and state images)
+
+		private:
+			// Copy constructs the first rows of src into the unconstructed chunk dst, entity ids included
+			inline void copyRows(unsigned char* dst, const unsigned char* src, std::size_t rows) const;
+
+			// Stamps for every chunk, only called on structural changes
+			inline void growStamps();
+
+			inline bool writtenSince(std::size_t chunk, std::uint64_t since) const
+			{
+				return stamps[chunk].load(std::memory_order_relaxed) > since;
+			}
+
+		private:
+			std::vector<std::size_t> columns; // Column by component id
+			std::vector<std::size_t> offsets; // Column offsets inside a chunk
+			std::vector<unsigned char*> chunks;
+			std::pmr::memory_resource* memory; // Chunks come from here
+			std::size_t capacity = 0;
+			std::size_t chunkBytes = FCS_CHUNK_SIZE;
+			std::size_t count = 0;
+			mutable std::vector<std::atomic<std::uint64_t>> stamps; // State clock of the last write by chunk, outlives released chunks
+			const std::uint64_t* clock; // State clock of the scene
+		};
+
+		// Location of an entity in the scene, the slot is free while archetype is nullptr
+		struct EntitySlot
+		{
+			Archetype* archetype = nullptr;
+			std::uint32_t row = 0;
+			std::uint32_t generation = 1;
+		};
+
+		// Pool of a single component type stored as a sparse set
+		// Components are packed in 'dense' while 'sparse' maps an entity index to its dense slot
+		class BasePool
 		{
-			tsp.second->update(this, deltaTime);
+		public:
+			static constexpr std::uint32_t npos = static_cast<std::uint32_t>(-1);
+
+			BasePool(std::pmr::memory_resource* memory) : packed(memory), sparse(memory) { }
+			virtual ~BasePool() { }
+
+			inline bool has(std::uint32_t entity) const
+			{
+				return entity < sparse.size() && sparse[entity] != npos;
+			}
+
+			inline std::size_t size() const { return packed.size(); }
+
+			// Entity indices in dense order
+			inline const std::uint32_t* entities() const { return packed.data(); }
+
+			// Dense slot of the entity's component, npos if it has none
+			inline std::uint32_t position(std::uint32_t entity) const { return has(entity) ? sparse[entity] : npos; }
+
+			// Type erased add/get, used when playing back command buffers
+			virtual void* emplace(std::uint32_t entity) = 0;
+			virtual void* find(std::uint32_t entity) = 0;
+
+			virtual void remove(std::uint32_t entity) = 0;
+
+			// Empty pool of the same component type
+			virtual std::unique_ptr<BasePool> makeEmpty(std::pmr::memory_resource* memory) const = 0;
+
+			// Copies the component of entity 'from' in 'other' to entity 'to' in this pool
+			virtual void copy(std::uint32_t to, const BasePool& other, std::uint32_t from) = 0;
+
+			// Components in dense order and their type
+			virtual const void* values() const = 0;
+			virtual const ComponentInfo* info() const = 0;
+
+			// Copies every component of 'other', a pool of the same type (see Scene::saveState)
+			virtual void assign(const BasePool& other) = 0;
+			virtual void clear() = 0;
+
+			// Stamps the components as written at the current state clock
+			inline void touch() { stamp.store(*clock, std::memory_order_relaxed); }
+
+		public:
+			static inline const std::uint64_t unclocked = 0;
+			const std::uint64_t* clock = &unclocked; // State clock of the scene
+			std::atomic<std::uint64_t> stamp { 0 }; // State clock of the last write, touched by parallel systems
+			std::uint64_t revision = 0; // State clock of the last component added or removed
+
+		protected:
+			std::pmr::vector<std::uint32_t> packed;
+			std::pmr::vector<std::uint32_t> sparse;
+		};
+
+		template<typename T>
+		class SparsePool : public BasePool
+		{
+		public:
+			SparsePool(std::pmr::memory_resource* memory) : BasePool(memory), dense(memory) { }
+
+			inline T& add(std::uint32_t entity)
+			{
+				revision = *clock;
+				touch();
+				if (entity >= sparse.size())
+				{
+					sparse.resize(entity + 1, npos);
+				}
+				sparse[entity] = static_cast<std::uint32_t>(packed.size());
+				packed.push_back(entity);
+				dense.emplace_back();
+				return dense.back();
+			}
+
+			inline T* get(std::uint32_t entity)
+			{
+				return has(entity) ? &dense[sparse[entity]] : nullptr;
+			}
+
+			inline T* data() { return dense.data(); }
+
+			void* emplace(std::uint32_t entity) override
+			{
+				return &add(entity);
+			}
+
+			void* find(std::uint32_t entity) override
+			{
+				return get(entity);
+			}
+
+			void remove(std::uint32_t entity) override
+			{
+				revision = *clock;
+				touch();
+				std::uint32_t slot = sparse[entity];
+				std::uint32_t last = static_cast<std::uint32_t>(packed.size() - 1);
+				if (slot != last)
+				{
+					dense[slot] = std::move(dense[last]);
+					packed[slot] = packed[last];
+					sparse[packed[slot]] = slot;
+				}
+				dense.pop_back();
+				packed.pop_back();
+				sparse[entity] = npos;
+			}
+
+			std::unique_ptr<BasePool> makeEmpty(std::pmr::memory_resource* memory) const override
+			{
+				return std::make_unique<SparsePool<T>>(memory);
+			}
+
+			void copy(std::uint32_t to, const BasePool& other, std::uint32_t from) override
+			{
+				// Copy first, 'other' might be this pool and add() can reallocate
+				const SparsePool<T>& source = static_cast<const SparsePool<T>&>(other);
+				T value = source.dense[source.sparse[from]];
+				add(to) = std::move(value);
+			}
+
+			const void* values() const override
+			{
+				return dense.data();
+			}
+
+			const ComponentInfo* info() const override
+			{
+				return getComponentInfo<T>();
+			}
+
+			void assign(const BasePool& other) override
+			{
+				const SparsePool<T>& source = static_cast<const SparsePool<T>&>(other);
+				revision = *clock;
+				touch();
+				packed = source.packed;
+				sparse = source.sparse;
+				dense = source.dense;
+			}
+
+			void clear() override
+			{
+				revision = *clock;
+				touch();
+				packed.clear();
+				sparse.clear();
+				dense.clear();
+			}
+
+		private:
+			std::pmr::vector<T> dense;
+		};
+
+		template<typename T, typename = void>
+		struct StorageOf : std::integral_constant<Storage, Storage::Archetype> { };
+
+		template<typename T>
+		struct StorageOf<T, std::void_t<decltype(T::ComponentStorage)>> : std::integral_constant<Storage, T::ComponentStorage> { };
+
+		template<typename T>
+		constexpr bool isSparse = StorageOf<T>::value == Storage::SparseSet;
+
+		template<typename... Types>
+		constexpr bool anySparse = (isSparse<Types> || ...);
+
+		template<typename T>
+		constexpr auto poolFactory() -> std::unique_ptr<BasePool> (*)(std::pmr::memory_resource*)
+		{
+			if constexpr (isSparse<T>)
+			{
+				return [](std::pmr::memory_resource* memory) -> std::unique_ptr<BasePool> { return std::make_unique<SparsePool<T>>(memory); };
+			}
+			else
+			{
+				return nullptr;
+			}
+		}
+
+		template<typename T, typename = void>
+		struct NameOf
+		{
+			static constexpr const char* value = nullptr;
+		};
+
+		template<typename T>
+		struct NameOf<T, std::void_t<decltype(T::ComponentName)>>
+		{
+			static constexpr const char* value = T::ComponentName;
+		};
+
+		template<typename T, typename = void>
+		struct HasSerializer : std::false_type { };
+
+		template<typename T>
+		struct HasSerializer<T, std::void_t<decltype(ComponentSerializer<T>::save(std::declval<SnapshotWriter&>(), std::declval<const T&>()))>> : std::true_type { };
+
+		template<typename T>
+		constexpr auto serializerSave() -> void (*)(SnapshotWriter&, const void*)
+		{
+			if constexpr (HasSerializer<T>::value)
+			{
+				return [](SnapshotWriter& writer, const void* src) { ComponentSerializer<T>::save(writer, *static_cast<const T*>(src)); };
+			}
+			else
+			{
+				return nullptr;
+			}
+		}
+
+		template<typename T>
+		constexpr auto serializerLoad() -> void (*)(SnapshotReader&, void*)
+		{
+			if constexpr (HasSerializer<T>::value)
+			{
+				return [](SnapshotReader& reader, void* dst) { ComponentSerializer<T>::load(reader, *static_cast<T*>(dst)); };
+			}
+			else
+			{
+				return nullptr;
+			}
+		}
+
+		template<typename T>
+		inline const ComponentInfo* getComponentInfo()
+		{
+			static_assert(alignof(T) <= FCS_CHUNK_ALIGN, "Component alignment exceeds FCS_CHUNK_ALIGN.");
+			static const ComponentInfo info = {
+				getComponentId<T>(),
+				sizeof(T),
+				alignof(T),
+				[](void* dst) { new (dst) T(); },
+				[](void* dst, const void* src) { new (dst) T(*static_cast<const T*>(src)); },
+				[](void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); static_cast<T*>(src)->~T(); },
+				[](void* dst, void* src) { *static_cast<T*>(dst) = std::move(*static_cast<T*>(src)); static_cast<T*>(src)->~T(); },
+				[](void* ptr) { static_cast<T*>(ptr)->~T(); },
+				poolFactory<T>(),
+				std::is_trivially_destructible<T>::value,
+				std::is_trivially_copyable<T>::value,
+				NameOf<T>::value,
+				std::is_trivially_copyable<T>::value && !HasSerializer<T>::value,
+				serializerSave<T>(),
+				serializerLoad<T>()
+			};
+			static const bool registered = registerComponentInfo(&info);
+			(void)registered;
+			return &info;
+		}
+	}
+
+	// Records structural changes to be applied later, at a sync point of the scene (see Scene::playback)
+	// Lets systems create, destroy and change entities while others may be iterating them
+	// Component values are staged in an arena owned by the buffer, which is reused after every playback
+	class CommandBuffer
+	{
+	public:
+		friend class Scene;
+
+		// Generation of the ids handed by instantiate(), those are only valid inside the same buffer
+		static constexpr std::uint32_t pendingGeneration = static_cast<std::uint32_t>(-1);
+
+		CommandBuffer() = default;
+		~CommandBuffer();
+
+		CommandBuffer(const CommandBuffer&) = delete;
+		CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+	public:
+		// Creates an entity on playback, the pending id can be used by the following commands of this buffer
+		inline EntityId instantiate();
+
+		inline void destroy(EntityId id);
+
+		// Adds the component on playback (kept as is if the entity already has it)
+		// The returned value is what gets added, it may be filled until the buffer is played back
+		template<typename T>
+		inline T& addComponent(EntityId id);
+
+		// Adds the component or overwrites the existing one on playback
+		template<typename T>
+		inline void setComponent(EntityId id, T value);
+
+		template<typename T>
+		inline void removeComponent(EntityId id);
+
+		static inline bool isPending(EntityId id) { return id.generation == pendingGeneration; }
+
+		inline bool empty() const { return commands.empty(); }
+		inline std::size_t size() const { return commands.size(); }
+
+		// Drops every command not played back yet
+		inline void clear();
+
+	private:
+		enum class Op : std::uint8_t
+		{
+			Instantiate,
+			Destroy,
+			Add,
+			Set,
+			Remove
+		};
+
+		struct Command
+		{
+			EntityId entity;
+			Op op;
+			const detail::ComponentInfo* info;
+			void* payload; // Staged value of Add/Set, nullptr once consumed
+		};
+
+		struct Block
+		{
+			unsigned char* data;
+			std::size_t size;
+		};
+
+		static constexpr std::size_t blockSize = 4 * 1024;
+
+		template<typename T>
+		inline void* stage(EntityId id, Op op);
+
+		// Bump allocation from the arena blocks
+		inline void* allocate(std::size_t size, std::size_t align);
+
+		inline void swap(CommandBuffer& other);
+
+	private:
+		std::vector<Command> commands;
+		std::vector<Block> blocks;
+		std::size_t block = 0; // Block being bumped
+		std::size_t offset = 0; // First free byte of the block
+		std::uint32_t pending = 0; // Entities instantiated so far
+	};
+
+	class Scene;
+
+	template<typename... U>
+	class System;
+
+	// Component access declared by a system, next to its events: System<Read<A>, Write<B>, SomeEvent>
+	// Systems whose access does not conflict run concurrently, systems declaring none run alone
+	// Concurrent systems must keep to their components, structural changes go through their command buffer
+	template<typename T>
+	struct Read { };
+
+	template<typename T>
+	struct Write { };
+
+	// Update phases in run order, each one ends with a sync point playing back the recorded commands
+	enum class Phase
+	{
+		PreUpdate,
+		Update,
+		PostUpdate,
+		RenderExtract
+	};
+
+	// Ordering constraints against another system of the same phase, next to the events: System<After<Physics>, SomeEvent>
+	// Constraints win over priorities, systems of different phases are always ordered by phase
+	template<typename T>
+	struct Before { };
+
+	template<typename T>
+	struct After { };
+
+	namespace detail
+	{
+		template<typename T, typename = void>
+		struct PhaseOf : std::integral_constant<Phase, Phase::Update> { };
+
+		template<typename T>
+		struct PhaseOf<T, std::void_t<decltype(T::SystemPhase)>> : std::integral_constant<Phase, T::SystemPhase> { };
+
+		template<typename T, typename = void>
+		struct PriorityOf : std::integral_constant<int, 0> { };
+
+		template<typename T>
+		struct PriorityOf<T, std::void_t<decltype(T::SystemPriority)>> : std::integral_constant<int, T::SystemPriority> { };
+
+		template<typename T>
+		struct OrderOf : std::false_type { };
+
+		template<typename T>
+		struct OrderOf<Before<T>> : std::true_type
+		{
+			static inline void declare(std::vector<std::size_t>& before, std::vector<std::size_t>&) { before.push_back(getSystemId<T>()); }
+		};
+
+		template<typename T>
+		struct OrderOf<After<T>> : std::true_type
+		{
+			static inline void declare(std::vector<std::size_t>&, std::vector<std::size_t>& after) { after.push_back(getSystemId<T>()); }
+		};
+
+		template<typename T>
+		struct AccessOf : std::false_type { };
+
+		template<typename T>
+		struct AccessOf<Read<T>> : std::true_type
+		{
+			static inline void declare(Signature& reads, Signature&) { reads.set(getComponentId<T>()); }
+		};
+
+		template<typename T>
+		struct AccessOf<Write<T>> : std::true_type
+		{
+			static inline void declare(Signature&, Signature& writes) { writes.set(getComponentId<T>()); }
+		};
+
+		// Work stealing job system shared by all scenes
+		// Every worker owns a deque, it pops its own tasks from the back and steals from the front of the others
+		// Threads waiting on their ranges run queued tasks meanwhile, so ranges can be nested freely
+		class JobSystem
+		{
+		public:
+			inline explicit JobSystem(std::size_t workers);
+			inline ~JobSystem();
+
+			JobSystem(const JobSystem&) = delete;
+			JobSystem& operator=(const JobSystem&) = delete;
+
+		public:
+			// Calls function(begin, end) over [0, count) in ranges of at most grain indices and waits for all of them
+			// Tasks are plain values queued in fixed rings, nothing is allocated per range
+			template<typename Function>
+			inline void parallelFor(std::size_t count, std::size_t grain, Function&& function);
+
+			// Calls function(i) for every i in [0, count)
+			template<typename Function>
+			inline void run(std::size_t count, Function&& function);
+
+			// Threads running tasks, the waiting one included
+			inline std::size_t size() const { return threads.size() + 1; }
+
+			// Job system shared by all scenes, sized by FCS_WORKER_THREADS
+			static inline JobSystem& instance();
+
+			// Index of the calling worker, 0 for threads outside the system
+			static inline std::size_t workerIndex() { return threadIndex(); }
+
+		private:
+			struct Task
+			{
+				void (*function)(void* data, std::size_t begin, std::size_t end);
+				void* data;
+				std::size_t begin;
+				std::size_t end;
+				std::atomic<std::size_t>* pending; // Ranges of the parallelFor left to finish
+			};
+
+			// Fixed size ring of tasks, the owner works at the back and thieves at the front
+			class Deque
+			{
+			public:
+				static constexpr std::size_t capacity = 1024;
+
+				inline bool push(const Task& task, std::atomic<std::size_t>& queued);
+				inline bool pop(Task& task);
+				inline bool steal(Task& task);
+
+			private:
+				std::mutex mutex;
+				Task tasks[capacity];
+				std::size_t head = 0; // Oldest task
+				std::size_t count = 0;
+			};
+
+			inline void work(std::size_t index);
+
+			// Pops a task of the thread's own deque or steals one, false if nothing is queued
+			inline bool find(Task& task);
+
+			inline void execute(const Task& task);
+
+			// Deque of the calling thread, threads outside the system share the first one
+			static inline std::size_t& threadIndex()
+			{
+				static thread_local std::size_t value = 0;
+				return value;
+			}
+
+		private:
+			std::vector<std::thread> threads;
+			std::unique_ptr<Deque[]> deques;
+			std::size_t dequeCount;
+			std::atomic<std::size_t> queued { 0 };
+			std::mutex sleepMutex;
+			std::condition_variable wake;
+			bool stop = false;
+		};
+	}
+
+	// Subscriptions only change on the updating thread, other threads queue their events with Scene::enqueue
+	class Subscriber
+	{
+	public:
+		virtual ~Subscriber() { }
+	};
+
+	namespace detail
+	{
+		// Subscribers of an event type, every subscriber remembers its slot so leaving is O(1)
+		// Slots left are cleared and reused, dispatch skips the empty ones
+		struct SubscriberSlots
+		{
+			std::vector<Subscriber*> slots;
+			std::vector<std::size_t> free;
+			std::size_t count = 0;
+		};
+	}
+
+	template<typename Evt>
+	class EventSubscriber : public Subscriber
+	{
+	public:
+		template<typename... U>
+		friend class System;
+		friend class Scene;
+		virtual ~EventSubscriber() { }
+
+	protected:
+		virtual void onEvent(Scene* scene, const Evt& event) = 0;
+
+		// Events queued with Scene::enqueue, delivered together at the flush
+		virtual void onEventBatch(Scene* scene, Span<const Evt> events)
+		{
+			for (const Evt& event : events)
+			{
+				onEvent(scene, event);
+			}
+		}
+
+	private:
+		inline void subscribe(Scene* scene);
+		inline void unsubscribe(Scene* scene);
+
+	private:
+		std::size_t slot = ~std::size_t(0); // In the subscribers of the event type of its scene
+	};
+
+	namespace detail
+	{
+		// Arguments of System<...> that are events to subscribe to, the others declare access or ordering
+		template<typename T>
+		constexpr bool isEvent = !AccessOf<T>::value && !OrderOf<T>::value;
+
+		// Empty base standing in for the event subscriber of the other arguments (one type per argument, so no duplicate bases)
+		template<typename T>
+		struct ArgumentBase { };
+
+		template<typename T>
+		using SystemBase = typename std::conditional<isEvent<T>, EventSubscriber<T>, ArgumentBase<T>>::type;
+	}
+
+	class BaseSystem
+	{
+	public:
+		friend class Scene;
+		template<typename... U>
+		friend class System;
+		virtual ~BaseSystem() { }
+
+		virtual void initialize(Scene* scene) = 0;
+		virtual void deinitialize(Scene* scene) = 0;
+		virtual void update(Scene* scene, float deltaTime) = 0;
+
+	protected:
+		// Structural changes recorded here are played back at the end of the system phase
+		inline CommandBuffer& getCommands() { return commands; }
+
+	protected:
+		bool isActive = true;
+
+	private:
+		CommandBuffer commands;
+		detail::Signature reads;
+		detail::Signature writes;
+		bool exclusive = true; // Declared no access, may touch anything
+		std::size_t id = 0; // System id
+		std::size_t sequence = 0; // Creation order in the scene, breaks priority ties
+		Phase phase = Phase::Update;
+		int priority = 0;
+		std::vector<std::size_t> before; // System ids that must run after this one
+		std::vector<std::size_t> after; // System ids that must run before this one
+#ifdef FCS_PROFILING
+		detail::SystemProfile profile;
+#endif
+#ifdef FCS_TRACING
+		const char* traceName = nullptr;
+#endif
+	};
+
+	// Events are subscribed to, Read<T>/Write<T> arguments declare the component access used for scheduling
+	// and Before<S>/After<S> arguments order the system against others of its phase
+	template<typename... Events>
+	class System : public BaseSystem, public detail::SystemBase<Events>...
+	{
+	public:
+		friend class Scene;
+		virtual ~System() { }
+		
+	private:
+		inline void internal_initialize(Scene* scene);
+		inline void internal_deinitialize(Scene* scene);
+
+	public:
+		System()
+		{
+			(declare<Events>(), ...);
+		}
+
+	private:
+		template <typename U>
+		void declare()
+		{
+			if constexpr (detail::AccessOf<U>::value)
+			{
+				detail::AccessOf<U>::declare(reads, writes);
+				exclusive = false;
+			}
+			else if constexpr (detail::OrderOf<U>::value)
+			{
+				detail::OrderOf<U>::declare(before, after);
+			}
+		}
+
+		template <typename U>
+		void call_subscribe(Scene* scene)
+		{
+			if constexpr (detail::isEvent<U>)
+			{
+				FCS::EventSubscriber<U>::subscribe(scene);
+			}
+		}
+
+		template <typename U>
+		void call_unsubscribe(Scene* scene)
+		{
+			if constexpr (detail::isEvent<U>)
+			{
+				FCS::EventSubscriber<U>::unsubscribe(scene);
+			}
+		}
+	};
+
+	template<typename T, typename = void>
+	class Handle;
+
+	// Lightweight reference to an entity of a scene, cheap to copy around
+	class Entity
+	{
+	public:
+		friend class Scene;
+		template<typename T, typename>
+		friend class Handle;
+
+	public:
+		Entity() = default;
+
+	public:
+		// Add a component of type to the entity
+		template<typename T>
+		inline Handle<T> addComponent();
+
+		// Remove a comnponent of type from the entity
+		template<typename T>
+		inline void removeComponent();
+
+		// Get a component of type in the entity
+		template<typename T>
+		inline Handle<T> getComponent();
+
+		// Check entity has a type of component
+		template<typename T>
+		inline bool has();
+
+		// Check entity has all types of components
+		template<typename T, typename U, typename... Args>
+		inline bool has();
+
+		// Get the id of the entity inside its scene
+		inline EntityId getId() const { return id; }
+
+	private:
+		Entity(Scene* scene, EntityId id) : scene(scene), id(id) { }
+
+		// Raw access to the component storage, nullptr if not present
+		template<typename T>
+		inline T* get();
+
+		inline detail::EntitySlot& slot() const;
+
+	private:
+		Scene* scene = nullptr;
+		EntityId id;
+	};
+
+	template<typename T, typename>
+	class Handle
+	{
+	public:
+		friend class Scene;
+		Handle() { data = std::weak_ptr<T>(); }
+		Handle(const Handle<T>& other) { data = other.data; }
+		Handle(std::weak_ptr<T> data) { this->data = data; }
+		~Handle() = default;
+
+	public:
+		T* operator->() const
+		{
+			return data.lock().get();
+		}
+
+		// Checks if the rvalue inside the handle is valid
+		inline bool expired()
+		{
+			return data.expired();
+		}
+
+	private:
+		std::weak_ptr<T> data;
+	};
+
+	// Components move between chunks on structural changes, so their handles resolve through the owning entity
+	template<typename T>
+	class Handle<T, typename std::enable_if<std::is_base_of<Component, T>::value>::type>
+	{
+	public:
+		friend class Scene;
+		Handle() = default;
+		Handle(Entity entity) : entity(entity) { }
+
+	public:
+		// Valid until the next structural change of the owning scene
+		inline T* operator->() const;
+
+		// Checks if the entity is gone or no longer has the component
+		inline bool expired() const;
+
+	private:
+		mutable Entity entity;
+	};
+
+	// Trivially copyable (scene, id) pair, checking it is an O(1) generation compare
+	template<>
+	class Handle<Entity>
+	{
+	public:
+		friend class Scene;
+		Handle() = default;
+		Handle(Entity entity) : entity(entity) { }
+
+	public:
+		// nullptr if the entity was destroyed
+		inline Entity* operator->() const
+		{
+			return expired() ? nullptr : &entity;
+		}
+
+		// Checks if the entity was destroyed
+		inline bool expired() const;
+
+		inline EntityId getId() const { return entity.id; }
+
+	private:
+		mutable Entity entity;
+	};
+
+	namespace detail
+	{
+		// Set of entities matching a signature, kept up to date by the scene on every structural change
+		class BaseQuery
+		{
+		public:
+			static constexpr std::uint32_t npos = static_cast<std::uint32_t>(-1);
+
+			BaseQuery(const Signature& mask) : mask(mask) { }
+			virtual ~BaseQuery() { }
+
+			// Entity created with the signature
+			inline void add(EntityId id, const Signature& signature)
+			{
+				if (signature.contains(mask))
+				{
+					insert(id);
+				}
+			}
+
+			// Entity with the signature destroyed
+			inline void remove(EntityId id, const Signature& signature)
+			{
+				if (signature.contains(mask))
+				{
+					erase(id);
+				}
+			}
+
+			// Components of a live entity changed
+			inline void update(EntityId id, const Signature& before, const Signature& after)
+			{
+				bool was = before.contains(mask);
+				bool is = after.contains(mask);
+				if (was != is)
+				{
+					if (is)
+					{
+						insert(id);
+					}
+					else
+					{
+						erase(id);
+					}
+				}
+			}
+
+			inline void insert(EntityId id)
+			{
+				if (id.index >= positions.size())
+				{
+					positions.resize(id.index + 1, npos);
+				}
+				positions[id.index] = static_cast<std::uint32_t>(matched.size());
+				matched.push_back(id);
+			}
+
+			inline void clear()
+			{
+				matched.clear();
+				positions.clear();
+			}
+
+			inline void erase(EntityId id)
+			{
+				std::uint32_t position = positions[id.index];
+				matched[position] = matched.back();
+				positions[matched[position].index] = position;
+				matched.pop_back();
+				positions[id.index] = npos;
+			}
+
+		protected:
+			Signature mask;
+			std::vector<EntityId> matched;
+			std::vector<std::uint32_t> positions; // Position in matched by id index
+		};
+	}
+
+	// Cached result of a component query, owned by the scene (see Scene::query)
+	// Structural changes while iterating may reorder the matched entities
+	template<typename... Types>
+	class Query : public detail::BaseQuery
+	{
+	public:
+		Query() : detail::BaseQuery(detail::signatureOf<Types...>()) { }
+
+	public:
+		inline const EntityId* begin() const { return matched.data(); }
+		inline const EntityId* end() const { return matched.data() + matched.size(); }
+
+		inline std::size_t size() const { return matched.size(); }
+		inline bool empty() const { return matched.empty(); }
+	};
+
+	namespace Event
+	{
+		struct EntityCreated
+		{
+			Handle<Entity> entity;
+		};
+
+		struct EntityDestroyed
+		{
+			Handle<Entity> entity;
+		};
+
+		// Emitted once by Scene::destroyAll, the entities are still alive while it is handled
+		struct EntitiesDestroyed
+		{
+			Span<const EntityId> entities;
+		};
+	}
+
+	class SceneManager;
+
+	template<typename... Types>
+	class View;
+
+	namespace detail
+	{
+		// Place of a queued event in the flush, the same whichever threads ran what
+		struct EventKey
+		{
+			std::uint32_t system; // Schedule position + 1 of the system that queued it, 0 outside systems
+			std::uint32_t segment; // Part of the update, every parallelEach range gets its own and the system moves past them
+			std::uint64_t sequence; // Queue order on its thread, counted per run of events
+
+			inline bool operator<(const EventKey& other) const
+			{
+				return std::tie(system, segment, sequence) < std::tie(other.system, other.segment, other.sequence);
+			}
+		};
+
+		// Key of the next event queued by this thread
+		inline EventKey& eventOrder()
+		{
+			static thread_local EventKey order = { };
+			return order;
+		}
+
+		// Sets the system and segment of the events queued meanwhile, restoring the ones of the scope it interrupted
+		class EventOrderScope
+		{
+		public:
+			inline EventOrderScope(std::uint32_t system, std::uint32_t segment) : previous(eventOrder())
+			{
+				eventOrder().system = system;
+				eventOrder().segment = segment;
+			}
+
+			inline ~EventOrderScope()
+			{
+				eventOrder().system = previous.system;
+				eventOrder().segment = previous.segment;
+			}
+
+			EventOrderScope(const EventOrderScope&) = delete;
+			EventOrderScope& operator=(const EventOrderScope&) = delete;
+
+		private:
+			EventKey previous;
+		};
+
+		// Events queued in a row under the same system and segment, up to the next run
+		struct EventRun
+		{
+			EventKey key; // Of the first event
+			std::size_t begin;
+		};
+
+		// Events of a type enqueued since the last flush
+		// Threads fill queues of their own, the scene holds one more per type that merges them at the flush
+		class BaseEventQueue
+		{
+		public:
+			virtual ~BaseEventQueue() { }
+
+			// Merges the queues of the threads in key order and hands the events to the subscribers as one batch
+			virtual void dispatch(Scene* scene) = 0;
+
+			std::vector<EventRun> runs; // Keys are kept per run, not per event
+			std::vector<EventRun> dispatchingRuns;
+		};
+
+		// Plain vectors, threads fill them concurrently and the scene memory is single threaded
+		template<typename T>
+		class EventQueue : public BaseEventQueue
+		{
+		public:
+			inline void dispatch(Scene* scene) override;
+
+			std::vector<T> events; // Merged ones on the queue of the scene
+			std::vector<T> dispatching; // Swapped with events while dispatching, so subscribers can enqueue more
+			std::vector<EventQueue<T>*> sources; // Queues of the threads being dispatched
+			std::vector<std::pair<EventKey, Span<const T>>> order;
+		};
+
+		// Queues of one thread, nothing else touches them until the flush
+		struct ThreadEvents
+		{
+			std::thread::id thread;
+			std::vector<std::unique_ptr<BaseEventQueue>> queues; // By event id
+			std::vector<std::size_t> queued; // Event ids with events queued
+#ifdef FCS_PROFILING
+			std::vector<Profile> profiles; // By event id, dispatches made by the thread, merged by Scene::stats
+#endif
+		};
+
+		// Commands recorded by a thread outside of systems
+		struct ThreadCommands
+		{
+			std::thread::id thread;
+			std::size_t worker; // JobSystem::workerIndex of the thread
+			CommandBuffer buffer;
+		};
+
+		// Events of a type kept for EventReader, published at the sync points and held for two updates
+		class BaseEventChannel
+		{
+		public:
+			virtual ~BaseEventChannel() { }
+
+			// Moves the emitted events into the current buffer
+			virtual void publish() = 0;
+
+			// Drops the previous buffer, the current one takes its place
+			virtual void swap() = 0;
+		};
+
+		template<typename T>
+		class EventChannel : public BaseEventChannel
+		{
+		public:
+			inline void publish() override
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				append(Span<const T>(emitted.data(), emitted.size()));
+				emitted.clear();
+			}
+
+			inline void swap() override
+			{
+				current ^= 1;
+				buffers[current].clear();
+				starts[current] = count;
+			}
+
+			// Only while no reader is reading, i.e. at the sync points
+			inline void append(Span<const T> events)
+			{
+				buffers[current].insert(buffers[current].end(), events.begin(), events.end());
+				count += events.size();
+			}
+
+			// Scene::emit may run on any thread, these wait for the next publish
+			inline void emit(const T& event)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				emitted.push_back(event);
+			}
+
+			std::vector<T> buffers[2]; // Previous and current update, indexed by current
+			std::size_t starts[2] = { }; // Sequence of the first event of each buffer
+			std::size_t current = 0;
+			std::size_t count = 0; // Events published so far, the sequence of the next one
+			std::vector<T> emitted;
+			std::mutex mutex;
+		};
+	}
+
+	// Pull side of the events of a type, a cursor over what the scene published for it (see Scene::reader)
+	// Every reader sees every event once, readers share the buffers so nothing is copied per reader
+	// Events stay for the update that published them and the next one, readers that run less often may miss some
+	// Updates are the simulation steps, events published by RenderExtract wait for the next step
+	template<typename T>
+	class EventReader
+	{
+	public:
+		EventReader() = default;
+		inline explicit EventReader(detail::EventChannel<T>* channel) : channel(channel), cursor(channel->count) { }
+
+		// Unread events, oldest first, split in the previous and the current buffer. Marks them as read
+		// Valid until the next sync point
+		inline std::pair<Span<const T>, Span<const T>> read()
+		{
+			if (!channel)
+			{
+				return { };
+			}
+
+			std::size_t current = channel->current;
+			std::size_t previous = current ^ 1;
+			if (cursor < channel->starts[previous])
+			{
+				dropped += channel->starts[previous] - cursor;
+				cursor = channel->starts[previous];
+			}
+
+			Span<const T> older;
+			if (cursor < channel->starts[current])
+			{
+				const std::vector<T>& buffer = channel->buffers[previous];
+				std::size_t offset = cursor - channel->starts[previous];
+				older = Span<const T>(buffer.data() + offset, buffer.size() - offset);
+			}
+
+			const std::vector<T>& buffer = channel->buffers[current];
+			std::size_t offset = std::max(cursor, channel->starts[current]) - channel->starts[current];
+			cursor = channel->count;
+			return { older, Span<const T>(buffer.data() + offset, buffer.size() - offset) };
+		}
+
+		// Calls function(const T&) for every unread event and marks them as read
+		template<typename Function>
+		inline std::size_t each(Function&& function)
+		{
+			auto [older, newer] = read();
+			for (const T& event : older)
+			{
+				function(event);
+			}
+
+			for (const T& event : newer)
+			{
+				function(event);
+			}
+			return older.size() + newer.size();
+		}
+
+		// Events published and not read yet, the ones already dropped excluded
+		inline std::size_t unread() const
+		{
+			return channel ? channel->count - std::max(cursor, channel->starts[channel->current ^ 1]) : 0;
+		}
+
+		// Events dropped before this reader got to them
+		inline std::size_t missed() const { return dropped; }
+
+	private:
+		detail::EventChannel<T>* channel = nullptr;
+		std::size_t cursor = 0; // Sequence of the next event to read
+		std::size_t dropped = 0;
+	};
+
+	// Reusable copy of the entities, components and id allocator of a scene (see Scene::saveState)
+	// Buffers are kept between saves, so saving into the same state again can copy only what was written since
+	class SceneState
+	{
+	public:
+		friend class Scene;
+		SceneState() = default;
+
+		SceneState(const SceneState&) = delete;
+		SceneState& operator=(const SceneState&) = delete;
+
+	public:
+		// Nothing saved yet
+		inline bool empty() const { return !saved; }
+
+	private:
+		bool saved = false;
+		std::uint64_t owner = 0; // Serial of the scene, buffers only match its chunks
+		std::uint64_t stamp = 0; // Storage stamped past this was written after the copy
+		std::vector<detail::EntitySlot> slots;
+		std::vector<detail::Signature> signatures;
+		std::vector<std::uint32_t> freeSlots;
+		std::vector<detail::BaseQuery> queries; // Matches of the active queries
+		std::vector<std::unique_ptr<detail::ArchetypeImage>> archetypes; // Same order as the scene
+		std::vector<std::unique_ptr<detail::BasePool>> pools; // By component id
+	};
+
+	class Scene
+	{
+	public:
+		template<typename U>
+		friend class EventSubscriber;
+		template<typename U>
+		friend class detail::EventQueue;
+		friend class SceneManager;
+		friend class Entity;
+		template<typename... Types>
+		friend class View;
+
+	protected:
+		// User code to initialize the scene
+		inline virtual void initialize() = 0;
+
+		// User code to clean the scene
+		inline virtual void deinitialize() = 0;
+
+	public:
+		// Instantiates a entity on the scene
+		inline Handle<Entity> instantiate(Handle<Entity> copy = Handle<Entity>());
+
+		// Destroys an entity on the scene
+		inline void destroy(Handle<Entity> value);
+		inline void destroy(EntityId id);
+
+		// Destroys a batch of entities, dead and repeated ids are ignored
+		// Emits a single Event::EntitiesDestroyed (EntityDestroyed only goes out if something subscribed to it)
+		// Archetypes left without entities are released at once instead of row by row
+		inline void destroyAll(Span<const EntityId> ids);
+
+		// Destroys every entity that has all the selected types
+		template<typename... Types>
+		inline void destroyAllWith();
+
+		// Checks if the id refers to a live entity of this scene
+		inline bool isAlive(EntityId id) const;
+
+		// Get the entity from a stored id (expired handle if not alive)
+		inline Handle<Entity> getEntity(EntityId id);
+
+		// Get all entities on the scene
+		inline std::vector<Handle<Entity>> getAll();
+
+		// Get all the entities that have all selected types in the scene
+		template<typename... Types>
+		inline std::vector<Handle<Entity>> getAllWith();
+
+		// Get the persistent query of the selected types, registered on first use
+		// The scene keeps it updated, so iterating it costs only the matched entities
+		template<typename... Types>
+		inline Query<Types...>& query();
+
+		// Calls function(EntityId, Types&...) or function(Types&...) for every entity with all types
+		// Walks the chunk columns directly, nothing is allocated. Do not change the structure while iterating
+		template<typename... Types, typename Function>
+		inline void each(Function&& function);
+
+		// Same as each but the matched rows are split in ranges of at most grainSize entities run across the job system
+		// The function is called concurrently, and returns once every entity was visited
+		template<typename... Types, typename Function>
+		inline void parallelEach(Function&& function, std::size_t grainSize = 1024);
+
+		// Range over the entities with all types, yields std::tuple<EntityId, Types&...>
+		template<typename... Types>
+		inline View<Types...> view();
+
+		// Cursor over the events of the type emitted or enqueued from now on, see EventReader
+		// They are published at the sync points, so readers see the events of earlier phases and updates
+		// Create readers outside of the updates, initialize of the system is a good place
+		template<typename T>
+		inline EventReader<T> reader();
+
+#ifndef SYSTEM_NOHANDLE
+		// Create a system in the scene
+		template<typename System>
+		inline Handle<System> createSystem();
+#else
+		// Create a system in the scene
+		template<typename System>
+		inline void createSystem();
+#endif
+		// Remove a system from the scene
+		template<typename System>
+		inline void deleteSystem();
+
+		// Emit an event to all active subscribers
+		template<typename T>
+		inline void emit(const T& event);
+
+		// Queues an event for the next flushEvents, subscribers get all the events of a type in one onEventBatch call
+		// Lock free, every thread copies its events into buffers of its own that are reused every frame
+		template<typename T>
+		inline void enqueue(const T& event);
+
+		// Dispatches the queued events, types in the order they were first enqueued. Call it while no other thread enqueues
+		// Events are ordered by the schedule position of the system that queued them, then the order they were queued in
+		// (parallelEach ranges by index), so the batches are the same whatever threads ran the systems
+		// Ranges of a parallelEach nested in another one only keep the order of their outer range
+		// Events enqueued by the subscribers meanwhile go out in the same flush. Called at the end of every update phase
+		inline void flushEvents();
+
+		// Bytes reserved and used by the memory of the scene
+		inline MemoryStats getMemoryStats() const { return memory.stats(); }
+
+		// Entity count and memory, plus per system and per event timings when built with FCS_PROFILING
+		// Call it between updates, the timings are written while systems run
+		inline SceneStats stats() const;
+
+		// Writes the entities and their components to a binary snapshot, false if the file can't be written
+		// Components are identified by ComponentName, the trivially copyable ones are written as raw blocks and
+		// the others through ComponentSerializer. Components that are neither, or share their name, are left out
+		inline bool saveSnapshot(const char* path) const;
+
+		// Replaces the entities of the scene with the ones of a snapshot, ids included
+		// False if it can't be read, is malformed or stores a component sparse or not unlike this program, the scene is
+		// then left untouched. The file is memory mapped and raw blocks are copied straight into the chunks. Unknown
+		// components are skipped. The entities that were here go with the usual events, ones their handlers create too
+		// but without. Ids and handles of all those must not be used anymore
+		inline bool loadSnapshot(const char* path);
+
+		// Copies the entities, their components and the id allocator into state, reusing its buffers
+		// With dirtyOnly, just the chunks and pools written since state was last saved or restored are copied
+		// Writes are noticed when components are handed out (each, view, get, commands...), so writing through a
+		// pointer or reference kept from before the save is missed by the dirty saves and restores that follow
+		// Pending commands, queued events and systems are not part of it, save between updates
+		inline void saveState(SceneState& state, bool dirtyOnly = true);
+
+		// Puts back the entities as they were when state was saved, false if it was saved from another scene
+		// With dirtyOnly, just the chunks and pools written since state was last saved or restored are copied
+		// No events are emitted, and ids issued after the save may be issued again
+		inline bool restoreState(SceneState& state, bool dirtyOnly = true);
+
+		// Appends what changed from 'from' to 'to' (both saved from this scene) to writer, see applyDelta
+		// Entities created and destroyed plus the components added, removed or changed. Changed raw components send
+		// the 32 bit words that differ XORed with the old ones, a bit per word plus varints, others their serialized value
+		// An empty 'from' stands for no entities at all. False if a state was saved from another scene
+		inline bool encodeDelta(const SceneState& from, const SceneState& to, SnapshotWriter& writer) const;
+
+		// Applies a delta to a scene holding the entities of its 'from' state, ids included, emitting the usual events
+		// Components are matched by name as in snapshots. The whole delta is read and checked against the entity slots
+		// first, false if it is malformed or does not fit them (stale generations, slots in use), the scene is then left
+		// untouched. Destruction handlers run before anything changes, false too if they leave the records unfit
+		inline bool applyDelta(const void* data, std::size_t size);
+
+		// Command buffer of the calling thread for this scene, played back with the system buffers
+		inline CommandBuffer& getThreadCommands();
+
+		// Event queues of the calling thread for this scene
+		inline detail::ThreadEvents& getThreadEvents();
+
+		// Applies the commands of the buffer and empties it
+		// Commands are grouped by entity and archetype, so every entity moves at most once
+		// Creation and destruction events are emitted after all changes were applied
+		inline void playback(CommandBuffer& buffer);
+
+		// Sync point, plays back the system buffers by system id and then the thread buffers by worker index
+		// Threads outside the job system share worker 0 and keep the order they first recorded in. Which worker runs
+		// a range of parallel work is not fixed, so commands recorded by different ranges have no set order
+		// Called at the end of every update phase
+		inline void flushCommands();
+
+	private:
+		// Runs the systems of the phases in [first, last]
+		inline void internal_update(float deltaTime, Phase first = Phase::PreUpdate, Phase last = Phase::RenderExtract);
+
+		// Registers a new system and initializes it
+		template<typename System>
+		inline void addSystem(std::shared_ptr<System> system);
+
+		// Orders the systems by phase, constraints, priority and creation, then cuts that order in batches
+		// The systems of a batch belong to the same phase and have no conflicting access or constraint
+		inline void buildSchedule();
+
+		// Archetype with the exact set of components, created if needed
+		inline detail::Archetype* getArchetype(std::vector<const detail::ComponentInfo*> infos);
+
+		// Neighbour archetypes with one component added/removed (cached as graph edges)
+		inline detail::Archetype* getArchetypeWith(detail::Archetype* from, const detail::ComponentInfo* info);
+		inline detail::Archetype* getArchetypeWithout(detail::Archetype* from, std::size_t id);
+
+		// Takes a free entity slot, recycling destroyed ones first
+		inline EntityId allocateId();
+
+		// Moves the entity to another archetype, constructing/destroying the components that differ
+		inline void moveEntity(EntityId id, detail::Archetype* to);
+
+		// Destroys the components of the entity and swaps the last row of its archetype into the hole
+		inline void releaseRow(EntityId id);
+
+		// Drops the entity from pools and queries and recycles its slot (its row must be gone already)
+		inline void releaseId(EntityId id);
+
+		// Generation of a slot once its entity is gone
+		static inline std::uint32_t nextGeneration(std::uint32_t generation);
+
+		// Sparse set pool of the component, created if needed
+		inline detail::BasePool* getPool(const detail::ComponentInfo* info);
+
+		// Checks if anyone is subscribed to the event type
+		template<typename T>
+		inline bool hasSubscribers() const;
+
+		// Calls onEventBatch of every subscriber of the event type
+		template<typename T>
+		inline void dispatchBatch(Span<const T> events);
+
+#ifdef FCS_PROFILING
+		// Adds a dispatch of the event type that started at start
+		template<typename T>
+		inline void profileEvent(std::size_t id, std::chrono::steady_clock::time_point start);
+#endif
+
+		// Sets the components of the entity and notifies the registered queries
+		inline void setSignature(EntityId id, const detail::Signature& signature);
+
+		// Registered query of the types or nullptr
+		template<typename... Types>
+		inline Query<Types...>* findQuery();
+
+		// Smallest pool among the sparse types, nullptr if one of them was never added
+		template<typename... Types>
+		inline detail::BasePool* smallestPool();
+
+		// Component of a live entity by id index, nullptr if not present
+		template<typename T>
+		inline T* fetch(std::uint32_t index);
+
+		// Sparse set pool of the component type, created if needed
+		template<typename T>
+		inline detail::SparsePool<T>* getPool();
+
+		// Sparse set pool of the component type or nullptr if none was created
+		template<typename T>
+		inline detail::SparsePool<T>* findPool();
+
+		// Stamps the storage of the component of an entity as written (see saveState)
+		template<typename T>
+		inline void touch(std::uint32_t index);
+
+		// Iterations driven by a sparse pool stamp the pools of the types before starting
+		// and then the archetype row of every entity they visit, unless all the types are sparse
+		template<typename... Types>
+		inline void touchPools();
+
+		template<typename... Types>
+		inline void touchVisited(std::uint32_t index);
+
+		// Any entity created, destroyed or changing components after the state clock
+		inline bool restructuredSince(std::uint64_t stamp) const;
+
+	public:
+		Scene() : slots(&memory), signatures(&memory), freeSlots(&memory), serial(nextSerial()) { root = getArchetype({}); }
+		virtual ~Scene() { }
+
+	private:
+		// Unique per scene instance, unlike its address
+		static inline std::uint64_t nextSerial()
+		{
+			static std::atomic<std::uint64_t> counter(0);
+			return counter.fetch_add(1, std::memory_order_relaxed);
+		}
+
+	private:
+		detail::SceneMemory memory; // First, so it is released after everything allocated from it
+		std::uint64_t stateClock = 1; // Stamps storage writes, ticks on every saveState and restoreState
+		std::uint64_t restoredTables = 0; // State clock of the last restore that put back the entity tables
+		std::vector<std::unique_ptr<detail::Archetype>> archetypes;
+		std::map<detail::Signature, detail::Archetype*> archetypeIndex;
+		detail::Archetype* root = nullptr;
+		std::vector<std::unique_ptr<detail::BasePool>> pools; // By component id
+		std::pmr::vector<detail::EntitySlot> slots; // Entity location by id index
+		std::pmr::vector<detail::Signature> signatures; // Components of the entity by id index, apart from slots so matching streams through memory
+		std::pmr::vector<std::uint32_t> freeSlots;
+		std::vector<std::shared_ptr<BaseSystem>> systems; // By system id
+		std::vector<detail::SubscriberSlots> subscribers; // By event id
+		std::vector<std::unique_ptr<detail::BaseEventQueue>> eventQueues; // By event id, merge the queues of the threads
+		std::vector<std::unique_ptr<detail::ThreadEvents>> threadEvents;
+		std::vector<std::pair<detail::EventKey, std::size_t>> flushingEvents; // First key and id of the types being flushed
+		std::vector<std::unique_ptr<detail::BaseEventChannel>> eventChannels; // By event id, only for types with readers
+		mutable std::mutex threadEventsMutex;
+		std::vector<std::unique_ptr<detail::BaseQuery>> queries; // By query id
+		std::vector<detail::BaseQuery*> activeQueries;
+		std::vector<std::unique_ptr<detail::ThreadCommands>> threadCommands; // By worker index
+		std::mutex threadCommandsMutex;
+		std::uint64_t serial;
+		std::vector<std::shared_ptr<BaseSystem>> schedule; // Systems in batch order
+		std::vector<std::size_t> batches; // End of every batch in the schedule
+		std::vector<std::size_t> syncs; // Batch count at the end of every phase that has systems
+		std::vector<Phase> syncPhases; // Phase ending at every sync
+		std::size_t systemSequence = 0;
+		bool scheduleDirty = true;
+	};
+
+	// Range based iteration over the entities having all the types (see Scene::view)
+	// Archetype components stream through the chunk columns, sparse types are driven by their smallest pool
+	template<typename... Types>
+	class View
+	{
+	public:
+		class Iterator
+		{
+		public:
+			friend class View;
+			using value_type = std::tuple<EntityId, Types&...>;
+
+		public:
+			inline value_type operator*() const;
+			inline Iterator& operator++();
+
+			inline bool operator!=(const Iterator& other) const
+			{
+				if constexpr (detail::anySparse<Types...>)
+				{
+					return cursor != other.cursor;
+				}
+				else
+				{
+					return current != other.current || chunk != other.chunk || row != other.row;
+				}
+			}
+
+		private:
+			// Skips to the next matching position (including the current one)
+			inline void seek();
+			inline void load();
+
+		private:
+			Scene* scene = nullptr;
+
+			// Archetype mode
+			const std::unique_ptr<detail::Archetype>* current = nullptr;
+			const std::unique_ptr<detail::Archetype>* last = nullptr;
+			std::size_t chunk = 0;
+			std::size_t row = 0;
+			std::size_t rows = 0;
+			const EntityId* ids = nullptr;
+			std::tuple<Types*...> columns;
+
+			// Sparse mode
+			const std::uint32_t* cursor = nullptr;
+			const std::uint32_t* end = nullptr;
+		};
+
+	public:
+		View(Scene* scene) : scene(scene) { }
+
+		inline Iterator begin() const;
+		inline Iterator end() const;
+
+	private:
+		Scene* scene;
+	};
+
+	//TODO: Extend states system (?)
+
+	// Main loop settings (see SceneManager::Tick)
+	struct LoopSettings
+	{
+		double fixedStep = 1.0 / 60.0; // Simulated seconds per update, the deltaTime systems receive, above 0
+		std::size_t maxSteps = 5; // Updates per tick at most, time left over past those is dropped so a slow frame does not spiral
+		double frameTime = 1.0 / 60.0; // Seconds per tick Run paces to by sleeping, 0 ticks back to back
+		std::function<void(double alpha, double deltaTime)> render; // Once per tick after the updates, alpha is the fraction of a step left to interpolate with
+	};
+
+	class SceneManager
+	{
+	public:
+		// Loads the selected scene on top of the stack
+		template<typename Scene>
+		static void LoadScene(bool unloadLast = false);
+
+		// Unloads last scene (top of stack)
+		static void UnloadScene();
+
+		// Get all scenes in the stack
+		static std::size_t GetSceneCount();
+
+		// Advances the top scene by the real time elapsed since the last tick (steady clock)
+		// Runs as many fixed steps as the accumulated time holds (up to maxSteps) through PreUpdate..PostUpdate,
+		// then the RenderExtract phase and the render callback once with the real elapsed time
+		static void Tick();
+
+		// Ticks until Stop is called or no scene is left, sleeping between ticks to hold the frame time
+		static void Run();
+
+		// Makes Run return after the current tick, safe from any thread
+		static void Stop();
+
+		static void SetLoopSettings(const LoopSettings& settings);
+		static const LoopSettings& GetLoopSettings();
+
+	private:
+		static inline SceneManager& Instance()
+		{
+			static SceneManager instance;
+			return instance;
+		}
+
+	private:
+		SceneManager() = default;
+
+	private:
+		std::stack<std::unique_ptr<Scene>> scenes;
+		LoopSettings settings;
+		std::chrono::steady_clock::time_point lastTick;
+		bool ticking = false; // lastTick is set
+		double accumulator = 0.0; // Real seconds not simulated yet
+		std::atomic<bool> running { false };
+	};
+
+	inline void Scene::internal_update(float deltaTime, Phase first, Phase last)
+	{
+		FCS_TRACE_SCOPE("Scene::update", "scene");
+		if (scheduleDirty)
+		{
+			buildSchedule();
+		}
+
+		// The schedule holds its systems until the next frame, deleted ones are only marked inactive
+		auto run = [this, deltaTime](std::size_t index) {
+			BaseSystem* system = schedule[index].get();
+			if (system->isActive)
+			{
+				detail::EventOrderScope order(static_cast<std::uint32_t>(index + 1), 0);
+#ifdef FCS_PROFILING
+				detail::SystemScope scope(system->profile);
+#endif
+				FCS_TRACE_SCOPE(system->traceName, "system");
+				system->update(this, deltaTime);
+			}
+		};
+
+		std::size_t begin = 0;
+		std::size_t batch = 0;
+		for (std::size_t p = 0; p < syncs.size(); p++)
+		{
+			bool active = syncPhases[p] >= first && syncPhases[p] <= last;
+			for (; batch < syncs[p]; batch++)
+			{
+				std::size_t end = batches[batch];
+				if (active && end - begin == 1)
+				{
+					run(begin);
+				}
+				else if (active)
+				{
+					detail::JobSystem::instance().run(end - begin, [&](std::size_t i) { run(begin + i); });
+				}
+				begin = end;
+			}
+
+			if (active)
+			{
+				flushCommands();
+				flushEvents();
+			}
+		}
+
+		// Commands and events recorded outside of systems
+		if (syncs.empty())
+		{
+			flushCommands();
+			flushEvents();
+		}
+
+		// Readers keep the events of this update and the last one
+		// Only a whole simulation step counts as an update, render extraction alone leaves the buffers in place
+		if (first > Phase::PostUpdate || last < Phase::PostUpdate)
+		{
+			return;
+		}
+
+		for (auto& channel : eventChannels)
+		{
+			if (channel)
+			{
+				channel->swap();
+			}
+		}
+	}
+
+	inline void Scene::buildSchedule()
+	{
+		// Constraint from a to b, declared on either side
+		auto precedes = [](const BaseSystem& a, const BaseSystem& b) {
+			return std::find(a.before.begin(), a.before.end(), b.id) != a.before.end() || std::find(b.after.begin(), b.after.end(), a.id) != b.after.end();
+		};
+
+		auto conflicts = [](const BaseSystem& a, const BaseSystem& b) {
+			return a.exclusive || b.exclusive || a.writes.intersects(b.reads) || a.writes.intersects(b.writes) || b.writes.intersects(a.reads);
+		};
+
+		std::vector<std::shared_ptr<BaseSystem>> remaining;
+		for (auto& system : systems)
+		{
+			if (system)
+			{
+				remaining.push_back(system);
+			}
+		}
+
+		std::sort(remaining.begin(), remaining.end(), [](const std::shared_ptr<BaseSystem>& a, const std::shared_ptr<BaseSystem>& b) {
+			return std::make_tuple(a->phase, a->priority, a->sequence) < std::make_tuple(b->phase, b->priority, b->sequence);
+		});
+
+		// Take the first system (phase, priority, creation) of the earliest phase that no other one has to precede
+		std::vector<std::shared_ptr<BaseSystem>> ordered;
+		while (!remaining.empty())
+		{
+			std::size_t pick = 0;
+			for (; pick < remaining.size() && remaining[pick]->phase == remaining.front()->phase; pick++)
+			{
+				bool blocked = false;
+				for (auto& other : remaining)
+				{
+					if (other != remaining[pick] && other->phase == remaining[pick]->phase && precedes(*other, *remaining[pick]))
+					{
+						blocked = true;
+						break;
+					}
+				}
+
+				if (!blocked)
+				{
+					break;
+				}
+			}
+
+			// A constraint cycle falls back to the priority order
+			bool found = pick < remaining.size() && remaining[pick]->phase == remaining.front()->phase;
+			assert(found && "Cyclic Before/After constraints between systems.");
+			pick = found ? pick : 0;
+
+			ordered.push_back(remaining[pick]);
+			remaining.erase(remaining.begin() + pick);
+		}
+
+		// Each system goes one batch after the last one it conflicts with, is constrained by or that belongs to an earlier phase
+		std::vector<std::size_t> levels;
+		std::size_t depth = 0;
+		for (std::size_t j = 0; j < ordered.size(); j++)
+		{
+			std::size_t level = 0;
+			for (std::size_t i = 0; i < j; i++)
+			{
+				if (ordered[i]->phase != ordered[j]->phase || precedes(*ordered[i], *ordered[j]) || conflicts(*ordered[i], *ordered[j]))
+				{
+					level = std::max(level, levels[i] + 1);
+				}
+			}
+			levels.push_back(level);
+			depth = std::max(depth, level + 1);
+		}
+
+		// Levels never mix phases, the order is sorted by phase and a new phase starts past every level before it
+		std::vector<Phase> phases(depth);
+		for (std::size_t j = 0; j < ordered.size(); j++)
+		{
+			phases[levels[j]] = ordered[j]->phase;
+		}
+
+		schedule.clear();
+		batches.clear();
+		syncs.clear();
+		syncPhases.clear();
+		for (std::size_t level = 0; level < depth; level++)
+		{
+			for (std::size_t j = 0; j < ordered.size(); j++)
+			{
+				if (levels[j] == level)
+				{
+					schedule.push_back(ordered[j]);
+				}
+			}
+			batches.push_back(schedule.size());
+
+			if (level + 1 == depth || phases[level + 1] != phases[level])
+			{
+				syncs.push_back(batches.size());
+				syncPhases.push_back(phases[level]);
+			}
+		}
+		scheduleDirty = false;
+	}
+
+	namespace detail
+	{
+		inline JobSystem::JobSystem(std::size_t workers) : deques(new Deque[workers + 1]), dequeCount(workers + 1)
+		{
+			for (std::size_t i = 0; i < workers; i++)
+			{
+				threads.emplace_back([this, i]() { work(i + 1); });
+			}
+		}
+
+		inline JobSystem::~JobSystem()
+		{
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				stop = true;
+			}
+			wake.notify_all();
+
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+		}
+
+		inline JobSystem& JobSystem::instance()
+		{
+			static JobSystem jobs(FCS_WORKER_THREADS > 0 ? FCS_WORKER_THREADS : std::max(std::thread::hardware_concurrency(), 1u) - 1);
+			return jobs;
+		}
+
+		template<typename Function>
+		inline void JobSystem::parallelFor(std::size_t count, std::size_t grain, Function&& function)
+		{
+			using F = typename std::remove_reference<Function>::type;
+
+			grain = std::max<std::size_t>(grain, 1);
+			std::size_t ranges = (count + grain - 1) / grain;
+			if (threads.empty() || ranges < 2)
+			{
+				if (count > 0)
+				{
+					function(std::size_t(0), count);
+				}
+				return;
+			}
+
+			std::atomic<std::size_t> pending(ranges);
+			Task task;
+			task.function = [](void* data, std::size_t begin, std::size_t end) { (*static_cast<F*>(data))(begin, end); };
+			task.data = const_cast<void*>(static_cast<const void*>(&function));
+			task.pending = &pending;
+
+			// Queued last to first, so the owner pops them in order while thieves take the far end
+			Deque& own = deques[threadIndex()];
+			for (std::size_t r = ranges; r > 0; r--)
+			{
+				task.begin = (r - 1) * grain;
+				task.end = std::min(count, task.begin + grain);
+				if (!own.push(task, queued))
+				{
+					execute(task);
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			wake.notify_all();
+
+			// Help instead of blocking, the missing ranges may be running elsewhere
+			while (pending.load(std::memory_order_acquire) > 0)
+			{
+				Task next;
+				if (find(next))
+				{
+					execute(next);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		template<typename Function>
+		inline void JobSystem::run(std::size_t count, Function&& function)
+		{
+			parallelFor(count, 1, [&function](std::size_t begin, std::size_t end) {
+				for (std::size_t i = begin; i < end; i++)
+				{
+					function(i);
+				}
+			});
+		}
+
+		inline void JobSystem::work(std::size_t index)
+		{
+			threadIndex() = index;
+#ifdef FCS_TRACING
+			Tracer::instance().nameThread("Worker " + std::to_string(index));
+#endif
+			while (true)
+			{
+				Task task;
+				if (find(task))
+				{
+					execute(task);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				wake.wait(lock, [this]() { return stop || queued.load() > 0; });
+				if (stop)
+				{
+					return;
+				}
+			}
+		}
+
+		inline bool JobSystem::find(Task& task)
+		{
+			std::size_t index = threadIndex();
+			if (deques[index].pop(task))
+			{
+				queued--;
+				return true;
+			}
+
+			for (std::size_t k = 1; k < dequeCount; k++)
+			{
+				if (deques[(index + k) % dequeCount].steal(task))
+				{
+					queued--;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		inline void JobSystem::execute(const Task& task)
+		{
+			FCS_TRACE_SCOPE("Job", "job");
+			task.function(task.data, task.begin, task.end);
+			task.pending->fetch_sub(1, std::memory_order_release);
+		}
+
+		inline bool JobSystem::Deque::push(const Task& task, std::atomic<std::size_t>& queued)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (count == capacity)
+			{
+				return false;
+			}
+
+			tasks[(head + count) % capacity] = task;
+			count++;
+
+			// Counted while locked, so it never drops below zero when the task is taken right away
+			queued++;
+			return true;
+		}
+
+		inline bool JobSystem::Deque::pop(Task& task)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (count == 0)
+			{
+				return false;
+			}
+
+			count--;
+			task = tasks[(head + count) % capacity];
+			return true;
+		}
+
+		inline bool JobSystem::Deque::steal(Task& task)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (count == 0)
+			{
+				return false;
+			}
+
+			task = tasks[head];
+			head = (head + 1) % capacity;
+			count--;
+			return true;
+		}
+	}
+
+	inline CommandBuffer::~CommandBuffer()
+	{
+		clear();
+		for (auto& b : blocks)
+		{
+			::operator delete(b.data, std::align_val_t(FCS_CHUNK_ALIGN));
+		}
+	}
+
+	inline EntityId CommandBuffer::instantiate()
+	{
+		EntityId id;
+		id.index = pending++;
+		id.generation = pendingGeneration;
+		commands.push_back({ id, Op::Instantiate, nullptr, nullptr });
+		return id;
+	}
+
+	inline void CommandBuffer::destroy(EntityId id)
+	{
+		commands.push_back({ id, Op::Destroy, nullptr, nullptr });
+	}
+
+	template<typename T>
+	inline T& CommandBuffer::addComponent(EntityId id)
+	{
+		return *static_cast<T*>(stage<T>(id, Op::Add));
+	}
+
+	template<typename T>
+	inline void CommandBuffer::setComponent(EntityId id, T value)
+	{
+		*static_cast<T*>(stage<T>(id, Op::Set)) = std::move(value);
+	}
+
+	template<typename T>
+	inline void CommandBuffer::removeComponent(EntityId id)
+	{
+		commands.push_back({ id, Op::Remove, detail::getComponentInfo<T>(), nullptr });
+	}
+
+	template<typename T>
+	inline void* CommandBuffer::stage(EntityId id, Op op)
+	{
+		assert(!isPending(id) || id.index < pending);
+		const detail::ComponentInfo* info = detail::getComponentInfo<T>();
+		void* payload = allocate(sizeof(T), alignof(T));
+		info->construct(payload);
+		commands.push_back({ id, op, info, payload });
+		return payload;
+	}
+
+	inline void* CommandBuffer::allocate(std::size_t size, std::size_t align)
+	{
+		while (true)
+		{
+			if (block < blocks.size())
+			{
+				std::size_t start = (offset + align - 1) & ~(align - 1);
+				if (start + size <= blocks[block].size)
+				{
+					offset = start + size;
+					return blocks[block].data + start;
+				}
+
+				if (block + 1 < blocks.size())
+				{
+					block++;
+					offset = 0;
+					continue;
+				}
+			}
+
+			// Blocks are aligned to FCS_CHUNK_ALIGN, which bounds every component alignment
+			std::size_t bytes = std::max(size, blockSize);
+			blocks.push_back({ static_cast<unsigned char*>(::operator new(bytes, std::align_val_t(FCS_CHUNK_ALIGN))), bytes });
+			block = blocks.size() - 1;
+			offset = 0;
+		}
+	}
+
+	inline void CommandBuffer::clear()
+	{
+		for (auto& command : commands)
+		{
+			if (command.payload)
+			{
+				command.info->destroy(command.payload);
+			}
+		}
+		commands.clear();
+		block = 0;
+		offset = 0;
+		pending = 0;
+	}
+
+	inline void CommandBuffer::swap(CommandBuffer& other)
+	{
+		std::swap(commands, other.commands);
+		std::swap(blocks, other.blocks);
+		std::swap(block, other.block);
+		std::swap(offset, other.offset);
+		std::swap(pending, other.pending);
+	}
+
+	namespace detail
+	{
+		inline void SceneMemory::release()
+		{
+			for (auto page : pages)
+			{
+				::operator delete(page, std::align_val_t(FCS_CHUNK_ALIGN));
+			}
+
+			for (auto& block : large)
+			{
+				::operator delete(block.first, std::align_val_t(block.second));
+			}
+
+			pages.clear();
+			large.clear();
+			std::fill(std::begin(freeLists), std::end(freeLists), nullptr);
+			pageOffset = FCS_ARENA_PAGE_SIZE;
+			reserved = 0;
+			used = 0;
+		}
+
+		inline std::size_t SceneMemory::sizeClass(std::size_t bytes, std::size_t align)
+		{
+			if (align > FCS_CHUNK_ALIGN)
+			{
+				return classCount;
+			}
+
+			// Blocks are carved at multiples of their size from aligned slabs, so the class also covers the alignment
+			std::size_t size = std::max({ bytes, align, minClass });
+			std::size_t index = 0;
+			while (index < classCount && (minClass << index) < size)
+			{
+				index++;
+			}
+			return index;
+		}
+
+		inline unsigned char* SceneMemory::bump(std::size_t bytes)
+		{
+			if (pageOffset + bytes > FCS_ARENA_PAGE_SIZE)
+			{
+				pages.push_back(static_cast<unsigned char*>(::operator new(FCS_ARENA_PAGE_SIZE, std::align_val_t(FCS_CHUNK_ALIGN))));
+				pageOffset = 0;
+				reserved += FCS_ARENA_PAGE_SIZE;
+			}
+
+			unsigned char* ptr = pages.back() + pageOffset;
+			pageOffset += bytes;
+			return ptr;
+		}
+
+		inline void* SceneMemory::do_allocate(std::size_t bytes, std::size_t align)
+		{
+			std::size_t index = sizeClass(bytes, align);
+			if (index == classCount)
+			{
+				align = std::max<std::size_t>(align, FCS_CHUNK_ALIGN);
+				void* ptr = ::operator new(bytes, std::align_val_t(align));
+				large.emplace(ptr, align);
+				reserved += bytes;
+				used += bytes;
+				return ptr;
+			}
+
+			std::size_t size = minClass << index;
+			if (!freeLists[index])
+			{
+				// Refill the class with a slab cut in blocks
+				std::size_t count = std::max<std::size_t>(slabSize / size, 1);
+				unsigned char* slab = bump(size * count);
+				for (std::size_t i = count; i > 0; i--)
+				{
+					FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + (i - 1) * size);
+					block->next = freeLists[index];
+					freeLists[index] = block;
+				}
+			}
+
+			FreeBlock* block = freeLists[index];
+			freeLists[index] = block->next;
+			used += size;
+			return block;
+		}
+
+		inline void SceneMemory::do_deallocate(void* ptr, std::size_t bytes, std::size_t align)
+		{
+			std::size_t index = sizeClass(bytes, align);
+			if (index == classCount)
+			{
+				auto it = large.find(ptr);
+				::operator delete(ptr, std::align_val_t(it->second));
+				large.erase(it);
+				reserved -= bytes;
+				used -= bytes;
+				return;
+			}
+
+			FreeBlock* block = static_cast<FreeBlock*>(ptr);
+			block->next = freeLists[index];
+			freeLists[index] = block;
+			used -= minClass << index;
+		}
+
+		inline Archetype::Archetype(std::vector<const ComponentInfo*> infos, std::pmr::memory_resource* memory, const std::uint64_t* clock) : components(std::move(infos)), memory(memory), clock(clock)
+		{
+			if (!components.empty())
+			{
+				columns.resize(components.back()->id + 1, npos);
+				for (std::size_t c = 0; c < components.size(); c++)
+				{
+					columns[components[c]->id] = c;
+					signature.set(components[c]->id);
+				}
+			}
+
+			// Each row also stores a back reference to its entity (first column)
+			std::size_t rowBytes = sizeof(EntityId);
+			for (auto info : components)
+			{
+				rowBytes += info->size;
+			}
+
+			// Fit as many rows as possible accounting for the alignment padding between columns
+			capacity = std::max<std::size_t>(chunkBytes / rowBytes, 1);
+			offsets.resize(components.size());
+			while (true)
+			{
+				std::size_t offset = sizeof(EntityId) * capacity;
+				for (std::size_t c = 0; c < components.size(); c++)
+				{
+					offset = (offset + components[c]->align - 1) / components[c]->align * components[c]->align;
+					offsets[c] = offset;
+					offset += components[c]->size * capacity;
+				}
+
+				if (offset <= chunkBytes)
+				{
+					break;
+				}
+				else if (capacity == 1)
+				{
+					// Component set larger than a chunk, grow the chunk to hold a single row
+					chunkBytes = offset;
+					break;
+				}
+				capacity--;
+			}
+		}
+
+		inline Archetype::~Archetype()
+		{
+			clear();
+		}
+
+		template<typename... Types>
+		inline bool Archetype::has() const
+		{
+			return signature.contains(signatureOf<Types...>());
+		}
+
+		inline void Archetype::writeRaw(std::size_t column, std::size_t row, const unsigned char* values, std::size_t count)
+		{
+			std::size_t size = components[column]->size;
+			while (count > 0)
+			{
+				std::size_t rows = std::min(count, capacity - row % capacity);
+				std::memcpy(get(column, row), values, rows * size);
+				values += rows * size;
+				row += rows;
+				count -= rows;
+			}
+		}
+
+		inline std::uint32_t Archetype::allocate(EntityId owner)
+		{
+			if (count == chunks.size() * capacity)
+			{
+				chunks.push_back(static_cast<unsigned char*>(memory->allocate(chunkBytes, FCS_CHUNK_ALIGN)));
+				growStamps();
+			}
+			touchRow(count);
+			revision = *clock;
+			entity(count) = owner;
+			return static_cast<std::uint32_t>(count++);
+		}
+
+		inline EntityId Archetype::remove(std::size_t row)
+		{
+			std::size_t last = count - 1;
+			EntityId moved;
+			touchRow(row);
+			touchRow(last);
+			revision = *clock;
+
+			// Keep rows packed by filling the hole with the last row
+			if (row != last)
+			{
+				for (std::size_t c = 0; c < components.size(); c++)
+				{
+					components[c]->relocate(get(c, row), get(c, last));
+				}
+				moved = entity(row) = entity(last);
+			}
+			count--;
+
+			// Release the trailing chunk once it is empty
+			if (count == (chunks.size() - 1) * capacity)
+			{
+				memory->deallocate(chunks.back(), chunkBytes, FCS_CHUNK_ALIGN);
+				chunks.pop_back();
+			}
+			return moved;
+		}
+
+		inline void Archetype::clear()
+		{
+			// Column by column, so each destructor loop streams through one array
+			for (std::size_t c = 0; c < components.size(); c++)
+			{
+				if (components[c]->trivialDestroy)
+				{
+					continue;
+				}
+
+				for (std::size_t chunk = 0; chunk < chunks.size(); chunk++)
+				{
+					unsigned char* column = chunks[chunk] + offsets[c];
+					std::size_t rows = chunkRows(chunk);
+					for (std::size_t row = 0; row < rows; row++)
+					{
+						components[c]->destroy(column + row * components[c]->size);
+					}
+				}
+			}
+
+			touchAll();
+			revision = *clock;
+			for (auto chunk : chunks)
+			{
+				memory->deallocate(chunk, chunkBytes, FCS_CHUNK_ALIGN);
+			}
+			chunks.clear();
+			count = 0;
+		}
+
+		inline void Archetype::growStamps()
+		{
+			if (stamps.size() < chunks.size())
+			{
+				std::vector<std::atomic<std::uint64_t>> grown(std::max(chunks.size(), stamps.size() * 2));
+				for (std::size_t chunk = 0; chunk < stamps.size(); chunk++)
+				{
+					grown[chunk].store(stamps[chunk].load(std::memory_order_relaxed), std::memory_order_relaxed);
+				}
+				stamps.swap(grown);
+			}
+		}
+
+		inline void Archetype::copyRows(unsigned char* dst, const unsigned char* src, std::size_t rows) const
+		{
+			std::memcpy(dst, src, rows * sizeof(EntityId));
+			for (std::size_t c = 0; c < components.size(); c++)
+			{
+				const ComponentInfo* info = components[c];
+				if (info->trivialCopy)
+				{
+					std::memcpy(dst + offsets[c], src + offsets[c], rows * info->size);
+					continue;
+				}
+
+				for (std::size_t row = 0; row < rows; row++)
+				{
+					info->copy(dst + offsets[c] + row * info->size, src + offsets[c] + row * info->size);
+				}
+			}
+		}
+
+		inline void Archetype::saveChunks(ArchetypeImage& image, std::uint64_t since) const
+		{
+			if (image.chunkBytes == 0)
+			{
+				image.components = components;
+				image.offsets = offsets;
+				image.capacity = capacity;
+				image.chunkBytes = chunkBytes;
+			}
+
+			for (std::size_t chunk = 0; chunk < chunks.size(); chunk++)
+			{
+				if (chunk == image.chunks.size())
+				{
+					image.chunks.push_back(static_cast<unsigned char*>(::operator new(chunkBytes, std::align_val_t(FCS_CHUNK_ALIGN))));
+					image.versions.push_back(0);
+				}
+				else if (!writtenSince(chunk, since))
+				{
+					continue;
+				}
+				else
+				{
+					destroyRows(components, offsets, image.chunks[chunk], image.chunkRows(chunk));
+				}
+				copyRows(image.chunks[chunk], chunks[chunk], chunkRows(chunk));
+				image.versions[chunk] = stamps[chunk].load(std::memory_order_relaxed);
+			}
+
+			// Values past the rows, the buffers stay for the next save
+			for (std::size_t chunk = chunks.size(); chunk < image.chunks.size(); chunk++)
+			{
+				destroyRows(components, offsets, image.chunks[chunk], image.chunkRows(chunk));
+			}
+			image.rows = count;
+		}
+
+		inline void Archetype::restoreChunks(const ArchetypeImage& image, std::uint64_t since)
+		{
+			std::size_t saved = (image.rows + capacity - 1) / capacity;
+
+			// Chunks added after the save, earlier chunks are full so chunkRows holds while popping
+			while (chunks.size() > saved)
+			{
+				destroyRows(components, offsets, chunks.back(), chunkRows(chunks.size() - 1));
+				memory->deallocate(chunks.back(), chunkBytes, FCS_CHUNK_ALIGN);
+				chunks.pop_back();
+				touch(chunks.size());
+			}
+
+			for (std::size_t chunk = 0; chunk < saved; chunk++)
+			{
+				if (chunk == chunks.size())
+				{
+					chunks.push_back(static_cast<unsigned char*>(memory->allocate(chunkBytes, FCS_CHUNK_ALIGN)));
+					growStamps();
+				}
+				else if (!writtenSince(chunk, since))
+				{
+					continue;
+				}
+				else
+				{
+					destroyRows(components, offsets, chunks[chunk], chunkRows(chunk));
+				}
+				copyRows(chunks[chunk], image.chunks[chunk], image.chunkRows(chunk));
+				touch(chunk);
+			}
+			count = image.rows;
+			revision = *clock;
+		}
+	}
+
+	inline detail::Archetype* Scene::getArchetype(std::vector<const detail::ComponentInfo*> infos)
+	{
+		std::sort(infos.begin(), infos.end(), [](const detail::ComponentInfo* a, const detail::ComponentInfo* b) { return a->id < b->id; });
+
+		detail::Signature key;
+		for (auto info : infos)
+		{
+			key.set(info->id);
+		}
+
+		auto found = archetypeIndex.find(key);
+		if (found != archetypeIndex.end())
+		{
+			return found->second;
+		}
+
+		archetypes.push_back(std::make_unique<detail::Archetype>(std::move(infos), &memory, &stateClock));
+		detail::Archetype* archetype = archetypes.back().get();
+		archetype->index = archetypes.size() - 1;
+		archetypeIndex.emplace(std::move(key), archetype);
+		return archetype;
+	}
+
+	namespace detail
+	{
+		inline void setEdge(std::vector<Archetype*>& edges, std::size_t id, Archetype* to)
+		{
+			if (id >= edges.size())
+			{
+				edges.resize(id + 1, nullptr);
+			}
+			edges[id] = to;
+		}
+	}
+
+	inline detail::Archetype* Scene::getArchetypeWith(detail::Archetype* from, const detail::ComponentInfo* info)
+	{
+		if (info->id < from->addEdges.size() && from->addEdges[info->id])
+		{
+			return from->addEdges[info->id];
+		}
+
+		auto infos = from->components;
+		infos.push_back(info);
+		detail::Archetype* to = getArchetype(std::move(infos));
+		detail::setEdge(from->addEdges, info->id, to);
+		detail::setEdge(to->removeEdges, info->id, from);
+		return to;
+	}
+
+	inline detail::Archetype* Scene::getArchetypeWithout(detail::Archetype* from, std::size_t id)
+	{
+		if (id < from->removeEdges.size() && from->removeEdges[id])
+		{
+			return from->removeEdges[id];
+		}
+
+		auto infos = from->components;
+		infos.erase(infos.begin() + from->column(id));
+		detail::Archetype* to = getArchetype(std::move(infos));
+		detail::setEdge(from->removeEdges, id, to);
+		detail::setEdge(to->addEdges, id, from);
+		return to;
+	}
+
+	inline EntityId Scene::allocateId()
+	{
+		EntityId id;
+		if (freeSlots.empty())
+		{
+			id.index = static_cast<std::uint32_t>(slots.size());
+			slots.emplace_back();
+			signatures.emplace_back();
+		}
+		else
+		{
+			id.index = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		id.generation = slots[id.index].generation;
+		return id;
+	}
+
+	inline void Scene::moveEntity(EntityId id, detail::Archetype* to)
+	{
+		detail::EntitySlot& slot = slots[id.index];
+		detail::Archetype* from = slot.archetype;
+		std::uint32_t row = to->allocate(id);
+
+		// Shared components are moved over, the ones left behind are destroyed
+		for (std::size_t c = 0; c < from->components.size(); c++)
+		{
+			std::size_t column = to->column(from->components[c]->id);
+			if (column != detail::Archetype::npos)
+			{
+				from->components[c]->relocate(to->get(column, row), from->get(c, slot.row));
+			}
+			else
+			{
+				from->components[c]->destroy(from->get(c, slot.row));
+			}
+		}
+
+		for (std::size_t c = 0; c < to->components.size(); c++)
+		{
+			if (from->column(to->components[c]->id) == detail::Archetype::npos)
+			{
+				to->components[c]->construct(to->get(c, row));
+			}
+		}
+
+		EntityId moved = from->remove(slot.row);
+		if (!moved.isNull())
+		{
+			slots[moved.index].row = slot.row;
+		}
+
+		slot.archetype = to;
+		slot.row = row;
+	}
+
+	template<typename T>
+	inline detail::SparsePool<T>* Scene::getPool()
+	{
+		std::size_t id = getComponentId<T>();
+		if (id >= pools.size())
+		{
+			pools.resize(id + 1);
+		}
+
+		auto& pool = pools[id];
+		if (!pool)
+		{
+			pool = std::make_unique<detail::SparsePool<T>>(&memory);
+			pool->clock = &stateClock;
+		}
+		return static_cast<detail::SparsePool<T>*>(pool.get());
+	}
+
+	inline detail::BasePool* Scene::getPool(const detail::ComponentInfo* info)
+	{
+		if (info->id >= pools.size())
+		{
+			pools.resize(info->id + 1);
+		}
+
+		auto& pool = pools[info->id];
+		if (!pool)
+		{
+			pool = info->makePool(&memory);
+			pool->clock = &stateClock;
+		}
+		return pool.get();
+	}
+
+	template<typename T>
+	inline detail::SparsePool<T>* Scene::findPool()
+	{
+		std::size_t id = getComponentId<T>();
+		if (id < pools.size())
+		{
+			return static_cast<detail::SparsePool<T>*>(pools[id].get());
+		}
+		return nullptr;
+	}
+
+	inline Handle<Entity> Scene::instantiate(Handle<Entity> copy)
+	{
+		EntityId id = allocateId();
+		detail::EntitySlot& slot = slots[id.index];
+
+		if (!copy.expired())
+		{
+			// Copies land on the same archetype, so the columns match one to one
+			Scene* other = copy.entity.scene;
+			const detail::EntitySlot& source = other->slots[copy.entity.id.index];
+			detail::Archetype* from = source.archetype;
+			detail::Archetype* to = other == this ? from : getArchetype(from->components);
+			slot.archetype = to;
+			slot.row = to->allocate(id);
+			signatures[id.index] = other->signatures[copy.entity.id.index];
+			for (std::size_t c = 0; c < to->components.size(); c++)
+			{
+				to->components[c]->copy(to->get(c, slot.row), from->get(c, source.row));
+			}
+
+			if (pools.size() < other->pools.size())
+			{
+				pools.resize(other->pools.size());
+			}
+
+			for (std::size_t p = 0; p < other->pools.size(); p++)
+			{
+				const auto& pool = other->pools[p];
+				if (pool && pool->has(copy.entity.id.index))
+				{
+					if (!pools[p])
+					{
+						pools[p] = pool->makeEmpty(&memory);
+						pools[p]->clock = &stateClock;
+					}
+					pools[p]->copy(id.index, *pool, copy.entity.id.index);
+				}
+			}
+		}
+		else
+		{
+			slot.archetype = root;
+			slot.row = root->allocate(id);
+		}
+
+		for (auto query : activeQueries)
+		{
+			query->add(id, signatures[id.index]);
+		}
+
+		Handle<Entity> handle(Entity(this, id));
+		emit<Event::EntityCreated>({ handle });
+		return handle;
+	}
+
+	inline void Scene::destroy(Handle<Entity> value)
+	{
+		if (value.entity.scene == this)
+		{
+			destroy(value.entity.id);
+		}
+	}
+
+	inline void Scene::destroy(EntityId id)
+	{
+		if (!isAlive(id))
+		{
+			return;
+		}
+
+		emit<Event::EntityDestroyed>({ Handle<Entity>(Entity(this, id)) });
+
+		// Handlers may have destroyed it already
+		if (isAlive(id))
+		{
+			releaseRow(id);
+			releaseId(id);
+		}
+	}
+
+	inline void Scene::destroyAll(Span<const EntityId> ids)
+	{
+		std::vector<EntityId> batch;
+		batch.reserve(ids.size());
+		for (EntityId id : ids)
+		{
+			if (isAlive(id))
+			{
+				batch.push_back(id);
+			}
+		}
+
+		std::sort(batch.begin(), batch.end(), [](EntityId a, EntityId b) { return a.index < b.index; });
+		batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+		if (batch.empty())
+		{
+			return;
+		}
+
+		emit<Event::EntitiesDestroyed>({ Span<const EntityId>(batch) });
+		if (hasSubscribers<Event::EntityDestroyed>())
+		{
+			for (EntityId id : batch)
+			{
+				if (isAlive(id))
+				{
+					emit<Event::EntityDestroyed>({ Handle<Entity>(Entity(this, id)) });
+				}
+			}
+		}
+
+		// Handlers may have destroyed some (and even recycled their slots)
+		batch.erase(std::remove_if(batch.begin(), batch.end(), [this](EntityId id) { return !isAlive(id); }), batch.end());
+
+		// Group by archetype, handlers may also have moved some. Archetype then entity index, so rows are removed
+		// in the same order on every run
+		std::stable_sort(batch.begin(), batch.end(), [this](EntityId a, EntityId b) {
+			return slots[a.index].archetype->index < slots[b.index].archetype->index;
+		});
+
+		std::size_t first = 0;
+		while (first < batch.size())
+		{
+			detail::Archetype* archetype = slots[batch[first].index].archetype;
+			std::size_t last = first;
+			while (last < batch.size() && slots[batch[last].index].archetype == archetype)
+			{
+				last++;
+			}
+
+			if (last - first == archetype->size())
+			{
+				archetype->clear();
+			}
+			else
+			{
+				for (std::size_t i = first; i < last; i++)
+				{
+					releaseRow(batch[i]);
+				}
+			}
+
+			for (std::size_t i = first; i < last; i++)
+			{
+				releaseId(batch[i]);
+			}
+			first = last;
+		}
+	}
+
+	template<typename... Types>
+	inline void Scene::destroyAllWith()
+	{
+		// Gathered without each, nothing is written so nothing gets stamped
+		const detail::Signature& mask = detail::signatureOf<Types...>();
+		std::vector<EntityId> batch;
+		if constexpr (detail::anySparse<Types...>)
+		{
+			if (detail::BasePool* driver = smallestPool<Types...>())
+			{
+				const std::uint32_t* indices = driver->entities();
+				for (std::size_t i = 0; i < driver->size(); i++)
+				{
+					if (signatures[indices[i]].contains(mask))
+					{
+						batch.push_back(EntityId{ indices[i], slots[indices[i]].generation });
+					}
+				}
+			}
+		}
+		else
+		{
+			for (auto& archetype : archetypes)
+			{
+				if (archetype->signature.contains(mask))
+				{
+					for (std::size_t chunk = 0; chunk < archetype->chunkCount(); chunk++)
+					{
+						batch.insert(batch.end(), archetype->chunkEntities(chunk), archetype->chunkEntities(chunk) + archetype->chunkRows(chunk));
+					}
+				}
+			}
+		}
+		destroyAll(batch);
+	}
+
+	inline void Scene::releaseRow(EntityId id)
+	{
+		detail::EntitySlot& slot = slots[id.index];
+		detail::Archetype* archetype = slot.archetype;
+		for (std::size_t c = 0; c < archetype->components.size(); c++)
+		{
+			archetype->components[c]->destroy(archetype->get(c, slot.row));
+		}
+
+		EntityId moved = archetype->remove(slot.row);
+		if (!moved.isNull())
+		{
+			slots[moved.index].row = slot.row;
+		}
+	}
+
+	inline void Scene::releaseId(EntityId id)
+	{
+		const detail::Signature& signature = signatures[id.index];
+		for (std::size_t p = 0; p < pools.size(); p++)
+		{
+			if (pools[p] && signature.test(p))
+			{
+				pools[p]->remove(id.index);
+			}
+		}
+
+		for (auto query : activeQueries)
+		{
+			query->remove(id, signature);
+		}
+
+		// Bumping the generation invalidates every id and handle still pointing here
+		detail::EntitySlot& slot = slots[id.index];
+		slot.archetype = nullptr;
+		slot.generation = nextGeneration(slot.generation);
+		signatures[id.index] = detail::Signature();
+		freeSlots.push_back(id.index);
+	}
+
+	inline std::uint32_t Scene::nextGeneration(std::uint32_t generation)
+	{
+		// Wrapping around skips the generations never issued: null (0) and pending (CommandBuffer::pendingGeneration)
+		return generation + 1 == CommandBuffer::pendingGeneration ? 1 : generation + 1;
+	}
+
+	inline detail::ThreadEvents& Scene::getThreadEvents()
+	{
+		// The scene owns the queues of every thread, each thread only caches those of the last scene it queued into
+		// Serials are never reused, so the cache of a scene that is gone never matches again
+		thread_local std::uint64_t lastSerial = ~std::uint64_t(0);
+		thread_local detail::ThreadEvents* last = nullptr;
+		if (lastSerial == serial)
+		{
+			return *last;
+		}
+
+		std::thread::id thread = std::this_thread::get_id();
+		std::lock_guard<std::mutex> lock(threadEventsMutex);
+		auto found = std::find_if(threadEvents.begin(), threadEvents.end(), [thread](const std::unique_ptr<detail::ThreadEvents>& events) {
+			return events->thread == thread;
+		});
+		if (found == threadEvents.end())
+		{
+			threadEvents.push_back(std::make_unique<detail::ThreadEvents>());
+			threadEvents.back()->thread = thread;
+			found = std::prev(threadEvents.end());
+		}
+
+		lastSerial = serial;
+		last = found->get();
+		return *last;
+	}
+
+	inline CommandBuffer& Scene::getThreadCommands()
+	{
+		// Same caching as getThreadEvents
+		thread_local std::uint64_t lastSerial = ~std::uint64_t(0);
+		thread_local CommandBuffer* last = nullptr;
+		if (lastSerial == serial)
+		{
+			return *last;
+		}
+
+		std::thread::id thread = std::this_thread::get_id();
+		std::lock_guard<std::mutex> lock(threadCommandsMutex);
+		auto found = std::find_if(threadCommands.begin(), threadCommands.end(), [thread](const std::unique_ptr<detail::ThreadCommands>& commands) {
+			return commands->thread == thread;
+		});
+		if (found == threadCommands.end())
+		{
+			// Kept by worker index, playback does not depend on which thread recorded first
+			auto commands = std::make_unique<detail::ThreadCommands>();
+			commands->thread = thread;
+			commands->worker = detail::JobSystem::workerIndex();
+			found = std::upper_bound(threadCommands.begin(), threadCommands.end(), commands->worker, [](std::size_t worker, const std::unique_ptr<detail::ThreadCommands>& other) {
+				return worker < other->worker;
+			});
+			found = threadCommands.insert(found, std::move(commands));
+		}
+
+		lastSerial = serial;
+		last = &(*found)->buffer;
+		return *last;
+	}
+
+	inline void Scene::playback(CommandBuffer& buffer)
+	{
+		if (buffer.empty())
+		{
+			return;
+		}
+
+		// Work on a detached batch, handlers of the events below may record into the buffer again
+		CommandBuffer batch;
+		batch.swap(buffer);
+		auto& commands = batch.commands;
+
+		// Existing entities grouped by archetype (by position, not address, so every run plays back alike) then entity,
+		// dead ones first and created ones last, recording order kept inside a group
+		auto key = [this](const CommandBuffer::Command& command) {
+			bool pending = CommandBuffer::isPending(command.entity);
+			std::size_t archetype = !pending && isAlive(command.entity) ? slots[command.entity.index].archetype->index + 1 : 0;
+			return std::make_tuple(pending, archetype, command.entity.index);
+		};
+		std::stable_sort(commands.begin(), commands.end(), [&key](const CommandBuffer::Command& a, const CommandBuffer::Command& b) {
+			return key(a) < key(b);
+		});
+
+		std::vector<EntityId> created;
+		std::vector<EntityId> destroyed;
+		std::vector<CommandBuffer::Command*> values; // Staged value per component of the current entity
+
+		std::size_t first = 0;
+		while (first < commands.size())
+		{
+			std::size_t last = first;
+			while (last < commands.size() && commands[last].entity == commands[first].entity)
+			{
+				last++;
+			}
+
+			EntityId id = commands[first].entity;
+			bool pending = CommandBuffer::isPending(id);
+			bool alive = pending || isAlive(id);
+			bool destroy = false;
+			for (std::size_t i = first; i < last; i++)
+			{
+				destroy |= commands[i].op == CommandBuffer::Op::Destroy;
+			}
+
+			if (!alive || destroy)
+			{
+				// Nothing else matters for an entity that goes away, created ones are never spawned
+				if (alive && !pending)
+				{
+					destroyed.push_back(id);
+				}
+
+				for (std::size_t i = first; i < last; i++)
+				{
+					if (commands[i].payload)
+					{
+						commands[i].info->destroy(commands[i].payload);
+						commands[i].payload = nullptr;
+					}
+				}
+				first = last;
+				continue;
+			}
+
+			if (pending)
+			{
+				id = allocateId();
+				slots[id.index].archetype = root;
+				slots[id.index].row = root->allocate(id);
+				for (auto query : activeQueries)
+				{
+					query->add(id, signatures[id.index]);
+				}
+				created.push_back(id);
+			}
+
+			// Walk the archetype graph and the signature without touching the entity yet
+			detail::Archetype* archetype = slots[id.index].archetype;
+			const detail::Signature before = signatures[id.index];
+			detail::Signature after = before;
+			values.clear();
+
+			for (std::size_t i = first; i < last; i++)
+			{
+				CommandBuffer::Command& command = commands[i];
+				if (command.op == CommandBuffer::Op::Instantiate)
+				{
+					continue;
+				}
+
+				std::size_t component = command.info->id;
+				auto value = std::find_if(values.begin(), values.end(), [component](CommandBuffer::Command* c) { return c->info->id == component; });
+				bool present = after.test(component);
+				bool replace = command.op == CommandBuffer::Op::Set || (command.op == CommandBuffer::Op::Add && !present) || command.op == CommandBuffer::Op::Remove;
+
+				if (replace && value != values.end())
+				{
+					(*value)->info->destroy((*value)->payload);
+					(*value)->payload = nullptr;
+					values.erase(value);
+				}
+
+				if (command.op == CommandBuffer::Op::Remove)
+				{
+					if (present)
+					{
+						after.reset(component);
+						if (!command.info->makePool)
+						{
+							archetype = getArchetypeWithout(archetype, component);
+						}
+					}
+				}
+				else if (replace)
+				{
+					if (!present)
+					{
+						after.set(component);
+						if (!command.info->makePool)
+						{
+							archetype = getArchetypeWith(archetype, command.info);
+						}
+					}
+					values.push_back(&command);
+				}
+				else
+				{
+					// Add over an existing component keeps it
+					command.info->destroy(command.payload);
+					command.payload = nullptr;
+				}
+			}
+
+			// Single move to the final archetype, then the sparse pools
+			if (archetype != slots[id.index].archetype)
+			{
+				moveEntity(id, archetype);
+			}
+
+			for (std::size_t p = 0; p < pools.size(); p++)
+			{
+				if (pools[p] && before.test(p) && !after.test(p))
+				{
+					pools[p]->remove(id.index);
+				}
+			}
+
+			for (auto command : values)
+			{
+				void* target;
+				if (command->info->makePool)
+				{
+					detail::BasePool* pool = getPool(command->info);
+					pool->touch();
+					target = pool->has(id.index) ? pool->find(id.index) : pool->emplace(id.index);
+				}
+				else
+				{
+					const detail::EntitySlot& slot = slots[id.index];
+					slot.archetype->touchRow(slot.row);
+					target = slot.archetype->get(slot.archetype->column(command->info->id), slot.row);
+				}
+				command->info->assign(target, command->payload);
+				command->payload = nullptr;
+			}
+
+			if (!(after == before))
+			{
+				setSignature(id, after);
+			}
+			first = last;
+		}
+
+		for (EntityId id : created)
+		{
+			if (isAlive(id))
+			{
+				emit<Event::EntityCreated>({ Handle<Entity>(Entity(this, id)) });
+			}
+		}
+
+		if (!destroyed.empty())
+		{
+			destroyAll(destroyed);
+		}
+
+		// Hand the arena back if nothing was recorded meanwhile
+		batch.clear();
+		if (buffer.empty())
+		{
+			buffer.swap(batch);
+		}
+	}
+
+	inline void Scene::flushCommands()
+	{
+		// By index, handlers may create systems
+		for (std::size_t i = 0; i < systems.size(); i++)
+		{
+			if (systems[i])
+			{
+				playback(systems[i]->commands);
+			}
+		}
+
+		// Lock only to read the list, playback may register the buffer of this thread
+		// Inserting it moves the later buffers up an index, one may be visited again but none is skipped
+		for (std::size_t i = 0; ; i++)
+		{
+			CommandBuffer* buffer;
+			{
+				std::lock_guard<std::mutex> lock(threadCommandsMutex);
+				if (i >= threadCommands.size())
+				{
+					break;
+				}
+				buffer = &threadCommands[i]->buffer;
+			}
+			playback(*buffer);
+		}
+	}
+
+	template<typename T>
+	inline bool Scene::hasSubscribers() const
+	{
+		std::size_t id = getEventId<T>();
+		return id < subscribers.size() && subscribers[id].count > 0;
+	}
+
+	inline void Scene::setSignature(EntityId id, const detail::Signature& signature)
+	{
+		for (auto query : activeQueries)
+		{
+			query->update(id, signatures[id.index], signature);
+		}
+		signatures[id.index] = signature;
+	}
+
+	inline bool Scene::isAlive(EntityId id) const
+	{
+		return id.index < slots.size() && slots[id.index].generation == id.generation && slots[id.index].archetype != nullptr;
+	}
+
+	inline Handle<Entity> Scene::getEntity(EntityId id)
+	{
+		return isAlive(id) ? Handle<Entity>(Entity(this, id)) : Handle<Entity>();
+	}
+
+	inline std::vector<Handle<Entity>> Scene::getAll()
+	{
+		std::vector<Handle<Entity>> ret;
+		ret.reserve(slots.size() - freeSlots.size());
+		for (auto& archetype : archetypes)
+		{
+			for (std::size_t row = 0; row < archetype->size(); row++)
+			{
+				ret.push_back(Handle<Entity>(Entity(this, archetype->entity(row))));
+			}
+		}
+		return ret;
+	}
+
+	template<typename ...Types>
+	inline std::vector<Handle<Entity>> Scene::getAllWith()
+	{
+		const detail::Signature& mask = detail::signatureOf<Types...>();
+		std::vector<Handle<Entity>> ret;
+
+		// Registered queries already know the answer
+		if (Query<Types...>* cached = findQuery<Types...>())
+		{
+			ret.reserve(cached->size());
+			for (EntityId id : *cached)
+			{
+				ret.push_back(Handle<Entity>(Entity(this, id)));
+			}
+			return ret;
+		}
+
+		if constexpr (detail::anySparse<Types...>)
+		{
+			// Walk the smallest of the requested pools and probe the entity for the other types
+			detail::BasePool* smallest = smallestPool<Types...>();
+			if (smallest == nullptr)
+			{
+				return ret;
+			}
+
+			for (std::size_t i = 0; i < smallest->size(); i++)
+			{
+				std::uint32_t index = smallest->entities()[i];
+				if (signatures[index].contains(mask))
+				{
+					ret.push_back(Handle<Entity>(Entity(this, EntityId{ index, slots[index].generation })));
+				}
+			}
+		}
+		else
+		{
+			for (auto& archetype : archetypes)
+			{
+				if (archetype->signature.contains(mask))
+				{
+					for (std::size_t row = 0; row < archetype->size(); row++)
+					{
+						ret.push_back(Handle<Entity>(Entity(this, archetype->entity(row))));
+					}
+				}
+			}
+		}
+		return ret;
+	}
+
+	template<typename... Types>
+	inline Query<Types...>& Scene::query()
+	{
+		std::size_t id = detail::getTypeId<detail::QueryFamily, Query<Types...>>();
+		if (id >= queries.size())
+		{
+			queries.resize(id + 1);
+		}
+
+		if (!queries[id])
+		{
+			// Seed with the entities matching so far, from here on it is updated incrementally
+			auto created = std::make_unique<Query<Types...>>();
+			for (std::uint32_t index = 0; index < slots.size(); index++)
+			{
+				if (slots[index].archetype != nullptr)
+				{
+					created->add(EntityId{ index, slots[index].generation }, signatures[index]);
+				}
+			}
+			activeQueries.push_back(created.get());
+			queries[id] = std::move(created);
+		}
+		return static_cast<Query<Types...>&>(*queries[id]);
+	}
+
+	template<typename... Types>
+	inline Query<Types...>* Scene::findQuery()
+	{
+		std::size_t id = detail::getTypeId<detail::QueryFamily, Query<Types...>>();
+		if (id < queries.size())
+		{
+			return static_cast<Query<Types...>*>(queries[id].get());
+		}
+		return nullptr;
+	}
+
+	template<typename... Types>
+	inline detail::BasePool* Scene::smallestPool()
+	{
+		detail::BasePool* smallest = nullptr;
+		bool missing = false;
+		([&]()
+		{
+			if constexpr (detail::isSparse<Types>)
+			{
+				detail::BasePool* pool = findPool<Types>();
+				if (pool == nullptr)
+				{
+					missing = true;
+				}
+				else if (smallest == nullptr || pool->size() < smallest->size())
+				{
+					smallest = pool;
+				}
+			}
+		}(), ...);
+		return missing ? nullptr : smallest;
+	}
+
+	template<typename T>
+	inline void Scene::touch(std::uint32_t index)
+	{
+		if constexpr (detail::isSparse<T>)
+		{
+			if (detail::SparsePool<T>* pool = findPool<T>())
+			{
+				pool->touch();
+			}
+		}
+		else
+		{
+			slots[index].archetype->touchRow(slots[index].row);
+		}
+	}
+
+	template<typename... Types>
+	inline void Scene::touchPools()
+	{
+		([&]() {
+			if constexpr (detail::isSparse<Types>)
+			{
+				if (detail::SparsePool<Types>* pool = findPool<Types>())
+				{
+					pool->touch();
+				}
+			}
+		}(), ...);
+	}
+
+	template<typename... Types>
+	inline void Scene::touchVisited(std::uint32_t index)
+	{
+		if constexpr (!(detail::isSparse<Types> && ...))
+		{
+			slots[index].archetype->touchRow(slots[index].row);
+		}
+	}
+
+	template<typename T>
+	inline T* Scene::fetch(std::uint32_t index)
+	{
+		if constexpr (detail::isSparse<T>)
+		{
+			detail::SparsePool<T>* pool = findPool<T>();
+			return pool ? pool->get(index) : nullptr;
+		}
+		else
+		{
+			const detail::EntitySlot& slot = slots[index];
+			std::size_t column = slot.archetype->column(getComponentId<T>());
+			if (column != detail::Archetype::npos)
+			{
+				return static_cast<T*>(slot.archetype->get(column, slot.row));
+			}
+			return nullptr;
+		}
+	}
+
+	namespace detail
+	{
+		template<typename Function, typename... Types>
+		inline void invokeEach(Function& function, EntityId id, Types&... components)
+		{
+			if constexpr (std::is_invocable<Function&, EntityId, Types&...>::value)
+			{
+				function(id, components...);
+			}
+			else
+			{
+				function(components...);
+			}
+		}
+
+		template<typename... Types, typename Function>
+		inline void eachRows(Function& function, const EntityId* ids, std::size_t rows, Types*... columns)
+		{
+			for (std::size_t row = 0; row < rows; row++)
+			{
+				invokeEach(function, ids[row], columns[row]...);
+			}
+		}
+	}
+
+	template<typename... Types, typename Function>
+	inline void Scene::each(Function&& function)
+	{
+		const detail::Signature& mask = detail::signatureOf<Types...>();
+		if constexpr (detail::anySparse<Types...>)
+		{
+			detail::BasePool* driver = smallestPool<Types...>();
+			if (driver == nullptr)
+			{
+				return;
+			}
+
+			const std::uint32_t* indices = driver->entities();
+			detail::countEntities(driver->size());
+			touchPools<Types...>();
+			for (std::size_t i = 0; i < driver->size(); i++)
+			{
+				std::uint32_t index = indices[i];
+				if (signatures[index].contains(mask))
+				{
+					touchVisited<Types...>(index);
+					detail::invokeEach(function, EntityId{ index, slots[index].generation }, *fetch<Types>(index)...);
+				}
+			}
+		}
+		else
+		{
+			for (auto& archetype : archetypes)
+			{
+				if (!archetype->signature.contains(mask))
+				{
+					continue;
+				}
+
+				detail::countEntities(archetype->size());
+				for (std::size_t chunk = 0; chunk < archetype->chunkCount(); chunk++)
+				{
+					archetype->touch(chunk);
+					detail::eachRows<Types...>(function, archetype->chunkEntities(chunk), archetype->chunkRows(chunk),
+						static_cast<Types*>(archetype->chunkColumn(chunk, archetype->column(getComponentId<Types>())))...);
+				}
+			}
+		}
+	}
+
+	template<typename... Types, typename Function>
+	inline void Scene::parallelEach(Function&& function, std::size_t grainSize)
+	{
+		detail::JobSystem& jobs = detail::JobSystem::instance();
+		const detail::Signature& mask = detail::signatureOf<Types...>();
+		if constexpr (detail::anySparse<Types...>)
+		{
+			detail::BasePool* driver = smallestPool<Types...>();
+			if (driver == nullptr)
+			{
+				return;
+			}
+
+			// Counted and pools stamped here, the ranges run on other threads
+			const std::uint32_t* indices = driver->entities();
+			detail::countEntities(driver->size());
+			touchPools<Types...>();
+			// Events queued by the ranges keep their order, the caller moves on past them
+			detail::EventKey& order = detail::eventOrder();
+			std::uint32_t system = order.system;
+			std::uint32_t segment = order.segment;
+			grainSize = std::max<std::size_t>(grainSize, 1);
+			order.segment += static_cast<std::uint32_t>((driver->size() + grainSize - 1) / grainSize + 1);
+			jobs.parallelFor(driver->size(), grainSize, [&](std::size_t begin, std::size_t end) {
+				detail::EventOrderScope scope(system, static_cast<std::uint32_t>(segment + begin / grainSize + 1));
+				for (std::size_t i = begin; i < end; i++)
+				{
+					std::uint32_t index = indices[i];
+					if (signatures[index].contains(mask))
+					{
+						touchVisited<Types...>(index);
+						detail::invokeEach(function, EntityId{ index, slots[index].generation }, *fetch<Types>(index)...);
+					}
+				}
+			});
+		}
+		else
+		{
+			// Chunks cut in slices of at most grainSize rows, one range each
+			struct Slice
+			{
+				const detail::Archetype* archetype;
+				std::size_t chunk;
+				std::size_t begin;
+				std::size_t end;
+			};
+
+			grainSize = std::max<std::size_t>(grainSize, 1);
+			std::vector<Slice> slices;
+			for (auto& archetype : archetypes)
+			{
+				if (!archetype->signature.contains(mask))
+				{
+					continue;
+				}
+
+				detail::countEntities(archetype->size());
+				for (std::size_t chunk = 0; chunk < archetype->chunkCount(); chunk++)
+				{
+					// Here, the ranges run on several threads
+					archetype->touch(chunk);
+					std::size_t rows = archetype->chunkRows(chunk);
+					for (std::size_t begin = 0; begin < rows; begin += grainSize)
+					{
+						slices.push_back({ archetype.get(), chunk, begin, std::min(rows, begin + grainSize) });
+					}
+				}
+			}
+
+			detail::EventKey& order = detail::eventOrder();
+			std::uint32_t system = order.system;
+			std::uint32_t segment = order.segment;
+			order.segment += static_cast<std::uint32_t>(slices.size() + 1);
+			jobs.parallelFor(slices.size(), 1, [&](std::size_t begin, std::size_t end) {
+				for (std::size_t s = begin; s < end; s++)
+				{
+					detail::EventOrderScope scope(system, static_cast<std::uint32_t>(segment + s + 1));
+					const Slice& slice = slices[s];
+					const detail::Archetype* archetype = slice.archetype;
+					detail::eachRows<Types...>(function, archetype->chunkEntities(slice.chunk) + slice.begin, slice.end - slice.begin,
+						static_cast<Types*>(archetype->chunkColumn(slice.chunk, archetype->column(getComponentId<Types>()))) + slice.begin...);
+				}
+			});
+		}
+	}
+
+	template<typename... Types>
+	inline View<Types...> Scene::view()
+	{
+		return View<Types...>(this);
+	}
+
+	template<typename T>
+	inline EventReader<T> Scene::reader()
+	{
+		std::size_t id = getEventId<T>();
+		if (id >= eventChannels.size())
+		{
+			eventChannels.resize(id + 1);
+		}
+
+		if (!eventChannels[id])
+		{
+			eventChannels[id] = std::make_unique<detail::EventChannel<T>>();
+		}
+		return EventReader<T>(static_cast<detail::EventChannel<T>*>(eventChannels[id].get()));
+	}
+
+	template<typename... Types>
+	inline typename View<Types...>::Iterator View<Types...>::begin() const
+	{
+		Iterator it;
+		it.scene = scene;
+		if constexpr (detail::anySparse<Types...>)
+		{
+			detail::BasePool* driver = scene->smallestPool<Types...>();
+			if (driver != nullptr)
+			{
+				it.cursor = driver->entities();
+				it.end = driver->entities() + driver->size();
+				detail::countEntities(driver->size());
+				scene->template touchPools<Types...>();
+			}
+		}
+		else
+		{
+			it.current = scene->archetypes.data();
+			it.last = scene->archetypes.data() + scene->archetypes.size();
+		}
+		it.seek();
+		return it;
+	}
+
+	template<typename... Types>
+	inline typename View<Types...>::Iterator View<Types...>::end() const
+	{
+		Iterator it;
+		it.scene = scene;
+		if constexpr (detail::anySparse<Types...>)
+		{
+			detail::BasePool* driver = scene->smallestPool<Types...>();
+			if (driver != nullptr)
+			{
+				it.cursor = driver->entities() + driver->size();
+			}
+		}
+		else
+		{
+			it.current = scene->archetypes.data() + scene->archetypes.size();
+		}
+		return it;
+	}
+
+	template<typename... Types>
+	inline typename View<Types...>::Iterator::value_type View<Types...>::Iterator::operator*() const
+	{
+		if constexpr (detail::anySparse<Types...>)
+		{
+			return value_type(EntityId{ *cursor, scene->slots[*cursor].generation }, *scene->template fetch<Types>(*cursor)...);
+		}
+		else
+		{
+			return std::apply([this](Types*... column) { return value_type(ids[row], column[row]...); }, columns);
+		}
+	}
+
+	template<typename... Types>
+	inline typename View<Types...>::Iterator& View<Types...>::Iterator::operator++()
+	{
+		if constexpr (detail::anySparse<Types...>)
+		{
+			++cursor;
+			seek();
+		}
+		else if (++row == rows)
+		{
+			row = 0;
+			if (++chunk == (*current)->chunkCount())
+			{
+				chunk = 0;
+				++current;
+				seek();
+			}
+			else
+			{
+				load();
+			}
+		}
+		return *this;
+	}
+
+	template<typename... Types>
+	inline void View<Types...>::Iterator::seek()
+	{
+		const detail::Signature& mask = detail::signatureOf<Types...>();
+		if constexpr (detail::anySparse<Types...>)
+		{
+			while (cursor != end && !scene->signatures[*cursor].contains(mask))
+			{
+				++cursor;
+			}
+
+			if (cursor != end)
+			{
+				scene->template touchVisited<Types...>(*cursor);
+			}
+		}
+		else
+		{
+			while (current != last && ((*current)->size() == 0 || !(*current)->signature.contains(mask)))
+			{
+				++current;
+			}
+
+			if (current != last)
+			{
+				load();
+			}
+		}
+	}
+
+	template<typename... Types>
+	inline void View<Types...>::Iterator::load()
+	{
+		const detail::Archetype* archetype = current->get();
+		ids = archetype->chunkEntities(chunk);
+		rows = archetype->chunkRows(chunk);
+		archetype->touch(chunk);
+		detail::countEntities(rows);
+		columns = std::tuple<Types*...>(static_cast<Types*>(archetype->chunkColumn(chunk, archetype->column(getComponentId<Types>())))...);
+	}
+
+	inline detail::EntitySlot& Entity::slot() const
+	{
+		return scene->slots[id.index];
+	}
+
+	template<typename T>
+	inline Handle<T> Entity::addComponent()
+	{
+		if (!has<T>())
+		{
+			if constexpr (detail::isSparse<T>)
+			{
+				scene->getPool<T>()->add(id.index);
+			}
+			else
+			{
+				scene->moveEntity(id, scene->getArchetypeWith(slot().archetype, detail::getComponentInfo<T>()));
+			}
+			detail::Signature signature = scene->signatures[id.index];
+			signature.set(getComponentId<T>());
+			scene->setSignature(id, signature);
+		}
+		return Handle<T>(*this);
+	}
+
+	template<typename T>
+	inline void Entity::removeComponent()
+	{
+		if (has<T>())
+		{
+			if constexpr (detail::isSparse<T>)
+			{
+				scene->findPool<T>()->remove(id.index);
+			}
+			else
+			{
+				scene->moveEntity(id, scene->getArchetypeWithout(slot().archetype, getComponentId<T>()));
+			}
+			detail::Signature signature = scene->signatures[id.index];
+			signature.reset(getComponentId<T>());
+			scene->setSignature(id, signature);
+		}
+	}
+
+	template<typename T>
+	inline Handle<T> Entity::getComponent()
+	{
+		if (has<T>())
+		{
+			return Handle<T>(*this);
+		}
+		return Handle<T>();
+	}
+
+	template<typename T>
+	inline T* Entity::get()
+	{
+		scene->touch<T>(id.index);
+		return scene->fetch<T>(id.index);
+	}
+
+	template<typename T>
+	inline bool Entity::has()
+	{
+		return scene->signatures[id.index].test(getComponentId<T>());
+	}
+
+	template<typename T, typename U, typename... Args>
+	inline bool Entity::has()
+	{
+		return scene->signatures[id.index].contains(detail::signatureOf<T, U, Args...>());
+	}
+
+	template<typename T>
+	inline T* Handle<T, typename std::enable_if<std::is_base_of<Component, T>::value>::type>::operator->() const
+	{
+		return entity.scene && entity.scene->isAlive(entity.id) ? entity.get<T>() : nullptr;
+	}
+
+	template<typename T>
+	inline bool Handle<T, typename std::enable_if<std::is_base_of<Component, T>::value>::type>::expired() const
+	{
+		return !entity.scene || !entity.scene->isAlive(entity.id) || !entity.has<T>();
+	}
+
+	inline bool Handle<Entity>::expired() const
+	{
+		return !entity.scene || !entity.scene->isAlive(entity.id);
+	}
+
+#ifndef SYSTEM_NOHANDLE
+	template<typename System>
+	inline Handle<System> Scene::createSystem()
+	{
+		std::size_t id = getSystemId<System>();
+		if (id >= systems.size())
+		{
+			systems.resize(id + 1);
+		}
+
+		if (!systems[id])
+		{
+			addSystem(std::make_shared<System>());
+		}
+		return Handle<System>(std::static_pointer_cast<System>(systems[id]));
+	}
+#else
+	template<typename System>
+	inline void Scene::createSystem()
+	{
+		std::size_t id = getSystemId<System>();
+		if (id >= systems.size())
+		{
+			systems.resize(id + 1);
+		}
+
+		if (!systems[id])
+		{
+			// No handles can outlive the scene, so the control block may live in its memory as well
+			addSystem(std::allocate_shared<System>(std::pmr::polymorphic_allocator<System>(&memory)));
+		}
+	}
+#endif
+
+	template<typename System>
+	inline void Scene::addSystem(std::shared_ptr<System> system)
+	{
+		system->id = getSystemId<System>();
+		system->sequence = systemSequence++;
+		system->phase = detail::PhaseOf<System>::value;
+		system->priority = detail::PriorityOf<System>::value;
+#ifdef FCS_PROFILING
+		system->profile.name = detail::typeName<System>();
+#endif
+#ifdef FCS_TRACING
+		system->traceName = detail::typeName<System>().c_str();
+#endif
+		systems[system->id] = system;
+		scheduleDirty = true;
+		system->internal_initialize(this);
+	}
+
+	template<typename System>
+	inline void Scene::deleteSystem()
+	{
+		std::size_t id = getSystemId<System>();
+		if (id < systems.size() && systems[id])
+		{
+			static_cast<System*>(systems[id].get())->internal_deinitialize(this);
+			systems[id]->isActive = false;
+			systems[id].reset();
+			scheduleDirty = true;
+		}
+	}
+
+	template<typename T>
+	inline void Scene::emit(const T& event)
+	{
+		std::size_t id = getEventId<T>();
+		FCS_TRACE_SCOPE(detail::typeName<T>().c_str(), "event");
+#ifdef FCS_PROFILING
+		auto start = std::chrono::steady_clock::now();
+#endif
+		if (id < eventChannels.size() && eventChannels[id])
+		{
+			static_cast<detail::EventChannel<T>*>(eventChannels[id].get())->emit(event);
+		}
+
+		if (id < subscribers.size())
+		{
+			// By index up to the current end, handlers may subscribe (growing the slots) or unsubscribe (clearing theirs)
+			for (std::size_t i = 0, count = subscribers[id].slots.size(); i < count; i++)
+			{
+				if (Subscriber* base = subscribers[id].slots[i])
+				{
+					static_cast<EventSubscriber<T>*>(base)->onEvent(this, event);
+				}
+			}
+		}
+#ifdef FCS_PROFILING
+		profileEvent<T>(id, start);
+#endif
+	}
+
+	namespace detail
+	{
+		constexpr char snapshotMagic[4] = { 'F', 'C', 'S', 'S' };
+		constexpr std::uint32_t snapshotVersion = 1;
+		constexpr std::uint32_t snapshotByteOrder = 0x01020304;
+		constexpr std::uint32_t snapshotRaw = 1; // Component flag, values are plain bytes
+
+		// Components a snapshot can hold, ones whose name is shared assert as they would be left out
+		inline bool isSerializable(const ComponentInfo* info)
+		{
+			if (!info->name || !(info->raw || info->save))
+			{
+				return false;
+			}
+
+			auto found = componentRegistry().find(info->name);
+			bool unique = found != componentRegistry().end() && found->second == info;
+			assert(unique && "Component name used by several types, give each its own (see FCS_COMPONENT_AS).");
+			return unique;
+		}
+
+		// Components written to a snapshot or delta, numbered as they are first met
+		struct ComponentTable
+		{
+			static constexpr std::uint32_t npos = static_cast<std::uint32_t>(-1);
+
+			// Checks if the component can be serialized, once per type
+			inline bool accepts(const ComponentInfo* info)
+			{
+				if (info->id >= accepted.size())
+				{
+					accepted.resize(info->id + 1, -1);
+				}
+
+				if (accepted[info->id] < 0)
+				{
+					accepted[info->id] = isSerializable(info);
+				}
+				return accepted[info->id] != 0;
+			}
+
+			// Index of the component, added to the table if it can be serialized, npos otherwise
+			inline std::uint32_t indexOf(const ComponentInfo* info)
+			{
+				if (info->id >= indices.size())
+				{
+					indices.resize(info->id + 1, npos);
+				}
+
+				if (indices[info->id] == npos && accepts(info))
+				{
+					indices[info->id] = static_cast<std::uint32_t>(infos.size());
+					infos.push_back(info);
+				}
+				return indices[info->id];
+			}
+
+			std::vector<const ComponentInfo*> infos;
+			std::vector<std::uint32_t> indices; // By component id
+			std::vector<signed char> accepted; // By component id, -1 until checked
+		};
+
+		// Serialized values of a component type loaded apart from the scene, so a snapshot or delta is fully read
+		// before anything changes. The ones not handed over are destroyed with it
+		class LoadedValues
+		{
+		public:
+			LoadedValues(const ComponentInfo* info, std::size_t count)
+				: info(info), values(static_cast<unsigned char*>(::operator new(std::max<std::size_t>(count, 1) * info->size, std::align_val_t(info->align)))) { }
+			inline ~LoadedValues();
+
+			LoadedValues(const LoadedValues&) = delete;
+			LoadedValues& operator=(const LoadedValues&) = delete;
+
+		public:
+			// Loads the next value, false if the reader failed on it
+			inline bool load(SnapshotReader& reader)
+			{
+				void* value = at(constructed);
+				info->construct(value);
+				constructed++;
+				info->load(reader, value);
+				return !reader.failed();
+			}
+
+			inline void* at(std::size_t index) { return values + index * info->size; }
+
+			// The values were moved out by relocate or assign, which also destroyed them
+			inline void release() { constructed = 0; }
+
+		private:
+			const ComponentInfo* info;
+			unsigned char* values;
+			std::size_t constructed = 0;
+		};
+
+		inline LoadedValues::~LoadedValues()
+		{
+			for (std::size_t i = 0; i < constructed; i++)
+			{
+				info->destroy(at(i));
+			}
+			::operator delete(values, std::align_val_t(info->align));
+		}
+	}
+
+	// Layout, all in native byte order:
+	// header: magic, version, byte order, component, slot, archetype and pool counts (u32 each)
+	// components: name (u32 length + chars), size, flags (u32 each)
+	// slots: generation of every entity slot (u32)
+	// archetypes: rows, column count, column component indices, entity indices (u32 each), then per column the byte
+	//     count (u64) and the values, raw columns are rows * size bytes
+	// pools: component index, count, entity indices (u32 each), byte count (u64) and the values
+	inline bool Scene::saveSnapshot(const char* path) const
+	{
+		std::FILE* file = std::fopen(path, "wb");
+		if (!file)
+		{
+			return false;
+		}
+
+		detail::ComponentTable table;
+
+		std::vector<const detail::Archetype*> stored;
+		for (auto& archetype : archetypes)
+		{
+			if (archetype->size() > 0)
+			{
+				stored.push_back(archetype.get());
+				for (auto info : archetype->components)
+				{
+					table.indexOf(info);
+				}
+			}
+		}
+
+		std::vector<const detail::BasePool*> storedPools;
+		for (auto& pool : pools)
+		{
+			if (pool && pool->size() > 0 && table.indexOf(pool->info()) != detail::ComponentTable::npos)
+			{
+				storedPools.push_back(pool.get());
+			}
+		}
+
+		SnapshotWriter writer;
+		writer.write(detail::snapshotMagic, sizeof(detail::snapshotMagic));
+		writer.write(detail::snapshotVersion);
+		writer.write(detail::snapshotByteOrder);
+		writer.write(static_cast<std::uint32_t>(table.infos.size()));
+		writer.write(static_cast<std::uint32_t>(slots.size()));
+		writer.write(static_cast<std::uint32_t>(stored.size()));
+		writer.write(static_cast<std::uint32_t>(storedPools.size()));
+		for (auto info : table.infos)
+		{
+			writer.writeString(info->name);
+			writer.write(static_cast<std::uint32_t>(info->size));
+			writer.write(info->raw ? detail::snapshotRaw : 0u);
+		}
+
+		for (const detail::EntitySlot& slot : slots)
+		{
+			writer.write(slot.generation);
+		}
+
+		bool ok = true;
+		auto flush = [&]() {
+			ok = ok && std::fwrite(writer.bytes().data(), 1, writer.bytes().size(), file) == writer.bytes().size();
+			writer.clear();
+		};
+
+		SnapshotWriter values;
+		for (const detail::Archetype* archetype : stored)
+		{
+			std::vector<std::size_t> columns;
+			for (std::size_t c = 0; c < archetype->components.size(); c++)
+			{
+				if (table.indices[archetype->components[c]->id] != detail::ComponentTable::npos)
+				{
+					columns.push_back(c);
+				}
+			}
+
+			writer.write(static_cast<std::uint32_t>(archetype->size()));
+			writer.write(static_cast<std::uint32_t>(columns.size()));
+			for (std::size_t c : columns)
+			{
+				writer.write(table.indices[archetype->components[c]->id]);
+			}
+
+			for (std::size_t row = 0; row < archetype->size(); row++)
+			{
+				writer.write(archetype->entity(row).index);
+			}
+			flush();
+
+			for (std::size_t c : columns)
+			{
+				const detail::ComponentInfo* info = archetype->components[c];
+				if (info->raw)
+				{
+					// Straight from the chunks
+					writer.write(static_cast<std::uint64_t>(archetype->size() * info->size));
+					flush();
+					for (std::size_t chunk = 0; chunk < archetype->chunkCount(); chunk++)
+					{
+						std::size_t bytes = archetype->chunkRows(chunk) * info->size;
+						ok = ok && std::fwrite(archetype->chunkColumn(chunk, c), 1, bytes, file) == bytes;
+					}
+				}
+				else
+				{
+					values.clear();
+					for (std::size_t row = 0; row < archetype->size(); row++)
+					{
+						info->save(values, archetype->get(c, row));
+					}
+					writer.write(static_cast<std::uint64_t>(values.bytes().size()));
+					writer.write(values.bytes().data(), values.bytes().size());
+					flush();
+				}
+			}
+		}
+
+		for (const detail::BasePool* pool : storedPools)
+		{
+			const detail::ComponentInfo* info = pool->info();
+			writer.write(table.indices[info->id]);
+			writer.write(static_cast<std::uint32_t>(pool->size()));
+			writer.write(pool->entities(), pool->size() * sizeof(std::uint32_t));
+			if (info->raw)
+			{
+				writer.write(static_cast<std::uint64_t>(pool->size() * info->size));
+				writer.write(pool->values(), pool->size() * info->size);
+			}
+			else
+			{
+				values.clear();
+				for (std::size_t i = 0; i < pool->size(); i++)
+				{
+					info->save(values, static_cast<const unsigned char*>(pool->values()) + i * info->size);
+				}
+				writer.write(static_cast<std::uint64_t>(values.bytes().size()));
+				writer.write(values.bytes().data(), values.bytes().size());
+			}
+			flush();
+		}
+
+		flush();
+		return (std::fclose(file) == 0) && ok;
+	}
+
+	inline bool Scene::loadSnapshot(const char* path)
+	{
+		FCS_TRACE_SCOPE("Scene::loadSnapshot", "resource");
+		detail::MappedFile file(path);
+		if (!file.valid())
+		{
+			return false;
+		}
+
+		SnapshotReader reader(file.data(), file.size());
+		const unsigned char* magic = reader.skip(sizeof(detail::snapshotMagic));
+		std::uint32_t version = reader.read<std::uint32_t>();
+		std::uint32_t byteOrder = reader.read<std::uint32_t>();
+		if (!magic || std::memcmp(magic, detail::snapshotMagic, sizeof(detail::snapshotMagic)) != 0 || version != detail::snapshotVersion || byteOrder != detail::snapshotByteOrder)
+		{
+			return false;
+		}
+
+		std::uint32_t componentCount = reader.read<std::uint32_t>();
+		std::uint32_t slotCount = reader.read<std::uint32_t>();
+		std::uint32_t archetypeCount = reader.read<std::uint32_t>();
+		std::uint32_t poolCount = reader.read<std::uint32_t>();
+
+		// Components of this program matching the table, nullptr for the ones that can't be loaded
+		std::vector<const detail::ComponentInfo*> components;
+		for (std::uint32_t i = 0; i < componentCount && !reader.failed(); i++)
+		{
+			std::string name = reader.readString();
+			std::uint32_t size = reader.read<std::uint32_t>();
+			bool raw = (reader.read<std::uint32_t>() & detail::snapshotRaw) != 0;
+
+			auto found = detail::componentRegistry().find(name);
+			const detail::ComponentInfo* info = found != detail::componentRegistry().end() ? found->second : nullptr;
+			if (info && (raw ? !info->raw || info->size != size : !info->load))
+			{
+				info = nullptr;
+			}
+			components.push_back(info);
+		}
+
+		const unsigned char* generations = reader.skip(static_cast<std::size_t>(slotCount) * sizeof(std::uint32_t));
+		if (reader.failed())
+		{
+			return false;
+		}
+
+		// Generations are ones releaseId could have left, never null or pending
+		for (std::uint32_t i = 0; i < slotCount; i++)
+		{
+			std::uint32_t generation;
+			std::memcpy(&generation, generations + i * sizeof(std::uint32_t), sizeof(std::uint32_t));
+			if (generation == 0 || generation == CommandBuffer::pendingGeneration)
+			{
+				return false;
+			}
+		}
+
+		// The whole file is read and checked first, serialized values loaded aside, so a bad one leaves the scene as is
+		// Raw values stay in the mapping until they are copied in
+		struct ArchetypeBlock
+		{
+			std::uint32_t rows;
+			const unsigned char* entities;
+			std::vector<const detail::ComponentInfo*> infos;
+			std::vector<const unsigned char*> raw; // By info, nullptr for serialized ones
+			std::vector<std::unique_ptr<detail::LoadedValues>> loaded; // By info, for serialized ones
+		};
+
+		struct PoolBlock
+		{
+			const detail::ComponentInfo* info;
+			std::uint32_t count;
+			const unsigned char* entities;
+			const unsigned char* raw;
+			std::unique_ptr<detail::LoadedValues> loaded;
+		};
+
+		auto indexAt = [](const unsigned char* indices, std::size_t i) {
+			std::uint32_t index;
+			std::memcpy(&index, indices + i * sizeof(std::uint32_t), sizeof(std::uint32_t));
+			return index;
+		};
+
+		// Serialized block of count values, every byte must be used
+		auto loadBlock = [](const detail::ComponentInfo* info, const unsigned char* block, std::uint64_t bytes, std::size_t count) {
+			auto loaded = std::make_unique<detail::LoadedValues>(info, count);
+			SnapshotReader values(block, static_cast<std::size_t>(bytes));
+			for (std::size_t i = 0; i < count; i++)
+			{
+				if (!loaded->load(values))
+				{
+					return std::unique_ptr<detail::LoadedValues>();
+				}
+			}
+			return values.remaining() == 0 ? std::move(loaded) : std::unique_ptr<detail::LoadedValues>();
+		};
+
+		std::vector<ArchetypeBlock> archetypeBlocks;
+		std::vector<bool> taken(slotCount, false);
+		for (std::uint32_t a = 0; a < archetypeCount; a++)
+		{
+			ArchetypeBlock block;
+			block.rows = reader.read<std::uint32_t>();
+			std::uint32_t columnCount = reader.read<std::uint32_t>();
+			const unsigned char* columnIndices = reader.skip(static_cast<std::size_t>(columnCount) * sizeof(std::uint32_t));
+			block.entities = reader.skip(static_cast<std::size_t>(block.rows) * sizeof(std::uint32_t));
+			if (reader.failed())
+			{
+				return false;
+			}
+
+			for (std::uint32_t c = 0; c < columnCount; c++)
+			{
+				std::uint32_t index = indexAt(columnIndices, c);
+				std::uint64_t bytes = reader.read<std::uint64_t>();
+				const unsigned char* values = reader.skip(static_cast<std::size_t>(bytes));
+				if (reader.failed() || index >= components.size())
+				{
+					return false;
+				}
+
+				// Components of this program only, unknown ones are skipped
+				const detail::ComponentInfo* info = components[index];
+				if (!info || std::find(block.infos.begin(), block.infos.end(), info) != block.infos.end())
+				{
+					continue;
+				}
+
+				// Saved when the component was not a sparse one
+				if (info->makePool)
+				{
+					return false;
+				}
+
+				std::unique_ptr<detail::LoadedValues> loaded;
+				if (info->raw ? bytes != std::uint64_t(block.rows) * info->size : !(loaded = loadBlock(info, values, bytes, block.rows)))
+				{
+					return false;
+				}
+				block.infos.push_back(info);
+				block.raw.push_back(info->raw ? values : nullptr);
+				block.loaded.push_back(std::move(loaded));
+			}
+
+			for (std::uint32_t r = 0; r < block.rows; r++)
+			{
+				std::uint32_t index = indexAt(block.entities, r);
+				if (index >= slotCount || taken[index])
+				{
+					return false;
+				}
+				taken[index] = true;
+			}
+			archetypeBlocks.push_back(std::move(block));
+		}
+
+		std::vector<PoolBlock> poolBlocks;
+		for (std::uint32_t p = 0; p < poolCount; p++)
+		{
+			PoolBlock block;
+			std::uint32_t index = reader.read<std::uint32_t>();
+			block.count = reader.read<std::uint32_t>();
+			block.entities = reader.skip(static_cast<std::size_t>(block.count) * sizeof(std::uint32_t));
+			std::uint64_t bytes = reader.read<std::uint64_t>();
+			const unsigned char* values = reader.skip(static_cast<std::size_t>(bytes));
+			if (reader.failed() || index >= components.size())
+			{
+				return false;
+			}
+
+			block.info = components[index];
+			if (!block.info)
+			{
+				continue;
+			}
+
+			// Saved when the component was a sparse one
+			if (!block.info->makePool)
+			{
+				return false;
+			}
+
+			// Every entity must be alive and listed once, and every pool be there once
+			std::vector<bool> listed(slotCount, false);
+			for (std::uint32_t i = 0; i < block.count; i++)
+			{
+				std::uint32_t entity = indexAt(block.entities, i);
+				if (entity >= slotCount || !taken[entity] || listed[entity])
+				{
+					return false;
+				}
+				listed[entity] = true;
+			}
+
+			bool repeated = std::any_of(poolBlocks.begin(), poolBlocks.end(), [&block](const PoolBlock& other) { return other.info == block.info; });
+			block.raw = block.info->raw ? values : nullptr;
+			if (repeated || (block.info->raw ? bytes != std::uint64_t(block.count) * block.info->size : !(block.loaded = loadBlock(block.info, values, bytes, block.count))))
+			{
+				return false;
+			}
+			poolBlocks.push_back(std::move(block));
+		}
+
+		// All good, the scene changes from here on
+		std::vector<EntityId> alive;
+		for (auto& archetype : archetypes)
+		{
+			for (std::size_t row = 0; row < archetype->size(); row++)
+			{
+				alive.push_back(archetype->entity(row));
+			}
+		}
+		destroyAll(Span<const EntityId>(alive.data(), alive.size()));
+
+		// Entities created by the handlers go too, without events
+		for (auto& archetype : archetypes)
+		{
+			while (archetype->size() > 0)
+			{
+				EntityId id = archetype->entity(archetype->size() - 1);
+				releaseRow(id);
+				releaseId(id);
+			}
+		}
+
+		slots.assign(slotCount, detail::EntitySlot());
+		signatures.assign(slotCount, detail::Signature());
+		freeSlots.clear();
+		for (std::uint32_t i = 0; i < slotCount; i++)
+		{
+			slots[i].generation = indexAt(generations, i);
+		}
+
+		for (ArchetypeBlock& block : archetypeBlocks)
+		{
+			detail::Archetype* archetype = getArchetype(block.infos);
+			std::size_t start = archetype->size();
+			for (std::uint32_t r = 0; r < block.rows; r++)
+			{
+				std::uint32_t index = indexAt(block.entities, r);
+				detail::EntitySlot& slot = slots[index];
+				slot.archetype = archetype;
+				slot.row = archetype->allocate(EntityId{ index, slot.generation });
+				signatures[index] = archetype->signature;
+			}
+
+			for (std::size_t i = 0; i < block.infos.size(); i++)
+			{
+				std::size_t column = archetype->column(block.infos[i]->id);
+				if (block.raw[i])
+				{
+					archetype->writeRaw(column, start, block.raw[i], block.rows);
+					continue;
+				}
+
+				for (std::uint32_t r = 0; r < block.rows; r++)
+				{
+					block.infos[i]->relocate(archetype->get(column, start + r), block.loaded[i]->at(r));
+				}
+				block.loaded[i]->release();
+			}
+		}
+
+		for (PoolBlock& block : poolBlocks)
+		{
+			detail::BasePool* pool = getPool(block.info);
+			for (std::uint32_t i = 0; i < block.count; i++)
+			{
+				std::uint32_t entity = indexAt(block.entities, i);
+				void* value = pool->emplace(entity);
+				if (block.raw)
+				{
+					std::memcpy(value, block.raw + i * block.info->size, block.info->size);
+				}
+				else
+				{
+					block.info->assign(value, block.loaded->at(i));
+				}
+				signatures[entity].set(block.info->id);
+			}
+
+			if (block.loaded)
+			{
+				block.loaded->release();
+			}
+		}
+
+		// Lowest indices are reused first
+		for (std::uint32_t i = slotCount; i > 0; i--)
+		{
+			if (!slots[i - 1].archetype)
+			{
+				freeSlots.push_back(i - 1);
+			}
+		}
+
+		bool notify = hasSubscribers<Event::EntityCreated>();
+		if (!activeQueries.empty() || notify)
+		{
+			for (std::uint32_t i = 0; i < slotCount; i++)
+			{
+				if (slots[i].archetype)
+				{
+					EntityId id{ i, slots[i].generation };
+					for (auto query : activeQueries)
+					{
+						query->add(id, signatures[i]);
+					}
+
+					if (notify)
+					{
+						emit<Event::EntityCreated>({ Handle<Entity>(Entity(this, id)) });
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	inline bool Scene::restructuredSince(std::uint64_t stamp) const
+	{
+		if (restoredTables > stamp)
+		{
+			return true;
+		}
+
+		for (auto& archetype : archetypes)
+		{
+			if (archetype->revision > stamp)
+			{
+				return true;
+			}
+		}
+
+		for (auto& pool : pools)
+		{
+			if (pool && pool->revision > stamp)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline void Scene::saveState(SceneState& state, bool dirtyOnly)
+	{
+		FCS_TRACE_SCOPE("Scene::saveState", "state");
+		if (!state.saved || state.owner != serial)
+		{
+			state.archetypes.clear();
+			state.pools.clear();
+			state.saved = true;
+			state.owner = serial;
+			dirtyOnly = false;
+		}
+		std::uint64_t since = dirtyOnly ? state.stamp : 0;
+
+		if (!dirtyOnly || restructuredSince(since))
+		{
+			state.slots.assign(slots.begin(), slots.end());
+			state.signatures.assign(signatures.begin(), signatures.end());
+			state.freeSlots.assign(freeSlots.begin(), freeSlots.end());
+			state.queries.clear();
+		}
+
+		// Queries follow the tables, apart from the ones created since
+		for (std::size_t i = state.queries.size(); i < activeQueries.size(); i++)
+		{
+			state.queries.push_back(*activeQueries[i]);
+		}
+
+		for (std::size_t i = 0; i < archetypes.size(); i++)
+		{
+			if (i == state.archetypes.size())
+			{
+				state.archetypes.push_back(std::make_unique<detail::ArchetypeImage>());
+			}
+			archetypes[i]->saveChunks(*state.archetypes[i], since);
+		}
+
+		state.pools.resize(pools.size());
+		for (std::size_t id = 0; id < pools.size(); id++)
+		{
+			if (!pools[id])
+			{
+				continue;
+			}
+
+			if (!state.pools[id])
+			{
+				state.pools[id] = pools[id]->makeEmpty(std::pmr::get_default_resource());
+			}
+			else if (pools[id]->stamp.load(std::memory_order_relaxed) <= since)
+			{
+				continue;
+			}
+			state.pools[id]->assign(*pools[id]);
+			state.pools[id]->stamp.store(pools[id]->stamp.load(std::memory_order_relaxed), std::memory_order_relaxed); // Copies with the same stamp match
+		}
+
+		state.stamp = stateClock++;
+	}
+
+	inline bool Scene::restoreState(SceneState& state, bool dirtyOnly)
+	{
+		FCS_TRACE_SCOPE("Scene::restoreState", "state");
+		if (!state.saved || state.owner != serial)
+		{
+			return false;
+		}
+		std::uint64_t since = dirtyOnly ? state.stamp : 0;
+		bool tables = !dirtyOnly || restructuredSince(since);
+
+		for (std::size_t i = 0; i < archetypes.size(); i++)
+		{
+			if (i < state.archetypes.size())
+			{
+				archetypes[i]->restoreChunks(*state.archetypes[i], since);
+			}
+			else if (archetypes[i]->size() > 0)
+			{
+				archetypes[i]->clear();
+			}
+		}
+
+		for (std::size_t id = 0; id < pools.size(); id++)
+		{
+			if (!pools[id])
+			{
+				continue;
+			}
+
+			if (id < state.pools.size() && state.pools[id])
+			{
+				if (pools[id]->stamp.load(std::memory_order_relaxed) > since)
+				{
+					pools[id]->assign(*state.pools[id]);
+				}
+			}
+			else if (pools[id]->size() > 0)
+			{
+				pools[id]->clear();
+			}
+		}
+
+		if (tables)
+		{
+			slots.assign(state.slots.begin(), state.slots.end());
+			signatures.assign(state.signatures.begin(), state.signatures.end());
+			freeSlots.assign(state.freeSlots.begin(), state.freeSlots.end());
+			for (std::size_t i = 0; i < activeQueries.size(); i++)
+			{
+				detail::BaseQuery& query = *activeQueries[i];
+				if (i < state.queries.size())
+				{
+					query = state.queries[i];
+					continue;
+				}
+
+				// Created after the save
+				query.clear();
+				for (std::uint32_t index = 0; index < slots.size(); index++)
+				{
+					if (slots[index].archetype != nullptr)
+					{
+						query.add(EntityId{ index, slots[index].generation }, signatures[index]);
+					}
+				}
+			}
+			restoredTables = stateClock;
+		}
+
+		state.stamp = stateClock++;
+		return true;
+	}
+
+	namespace detail
+	{
+		constexpr char deltaMagic[4] = { 'F', 'C', 'S', 'D' };
+		constexpr std::uint32_t deltaVersion = 1;
+
+		enum DeltaRecord : std::uint32_t
+		{
+			DeltaUpdate,
+			DeltaCreate, // Followed by the generation
+			DeltaDestroy // Followed by the generation destroyed
+		};
+
+		enum DeltaChange : std::uint32_t
+		{
+			DeltaChanged,
+			DeltaAdded,
+			DeltaRemoved
+		};
+
+		inline std::uint32_t xorWord(const unsigned char* before, const unsigned char* after, std::size_t size, std::size_t word)
+		{
+			std::uint32_t a = 0;
+			std::uint32_t b = 0;
+			std::size_t bytes = std::min<std::size_t>(4, size - word * 4);
+			if (before)
+			{
+				std::memcpy(&a, before + word * 4, bytes);
+			}
+			std::memcpy(&b, after + word * 4, bytes);
+			return a ^ b;
+		}
+
+		// Raw value as 32 bit words XORed with the old one (zeros if none), a mask byte per 8 words flags the ones that follow as varints
+		inline void writeXor(SnapshotWriter& writer, const unsigned char* before, const unsigned char* after, std::size_t size)
+		{
+			std::size_t words = (size + 3) / 4;
+			for (std::size_t word = 0; word < words; word += 8)
+			{
+				// A mask byte covers 8 words, XORed once
+				std::uint32_t bits[8];
+				std::size_t count = std::min<std::size_t>(8, words - word);
+				unsigned char mask = 0;
+				for (std::size_t bit = 0; bit < count; bit++)
+				{
+					bits[bit] = xorWord(before, after, size, word + bit);
+					mask |= static_cast<unsigned char>(bits[bit] != 0) << bit;
+				}
+				writer.write(mask);
+
+				for (std::size_t bit = 0; bit < count; bit++)
+				{
+					if (bits[bit])
+					{
+						writer.writeVarint(bits[bit]);
+					}
+				}
+			}
+		}
+
+		// XORs the words read into value, nullptr just skips them
+		inline void readXor(SnapshotReader& reader, unsigned char* value, std::size_t size)
+		{
+			std::size_t words = (size + 3) / 4;
+			unsigned char mask = 0;
+			for (std::size_t word = 0; word < words && !reader.failed(); word++)
+			{
+				if (word % 8 == 0)
+				{
+					mask = reader.read<unsigned char>();
+				}
+
+				if (!((mask >> (word % 8)) & 1))
+				{
+					continue;
+				}
+
+				std::uint32_t bits = static_cast<std::uint32_t>(reader.readVarint());
+				if (value)
+				{
+					std::uint32_t current = 0;
+					std::size_t bytes = std::min<std::size_t>(4, size - word * 4);
+					std::memcpy(&current, value + word * 4, bytes);
+					current ^= bits;
+					std::memcpy(value + word * 4, &current, bytes);
+				}
+			}
+		}
+	}
+
+	// Layout, varints unless noted:
+	// header: magic (4 chars), version, byte order (u32), component count, slot count of 'to', record count
+	// components: name (u32 length + chars), size, flags
+	// records by ascending index: index minus the previous one, DeltaRecord, generation (creations and destructions),
+	//     then for creations and updates the change count and the changes: table index << 2 | DeltaChange, then the value
+	//     (raw: XOR words, others: byte count and serialized value) unless removed
+	inline bool Scene::encodeDelta(const SceneState& from, const SceneState& to, SnapshotWriter& writer) const
+	{
+		FCS_TRACE_SCOPE("Scene::encodeDelta", "state");
+		if (!to.saved || to.owner != serial || (from.saved && from.owner != serial))
+		{
+			return false;
+		}
+
+		// Components stored in pools by either state
+		std::vector<const detail::ComponentInfo*> pooled;
+		for (const SceneState* state : { &from, &to })
+		{
+			for (auto& pool : state->pools)
+			{
+				if (pool && std::find(pooled.begin(), pooled.end(), pool->info()) == pooled.end())
+				{
+					pooled.push_back(pool->info());
+				}
+			}
+		}
+
+		auto imageOf = [&](const SceneState& state, const detail::EntitySlot& slot) {
+			return state.archetypes[slot.archetype->index].get();
+		};
+
+		// Archetypes whose chunks were all copied at the same stamps hold the same rows, so their entities did not
+		// change unless a pool did, those are skipped before anything else
+		bool poolsChanged = false;
+		for (const detail::ComponentInfo* info : pooled)
+		{
+			const detail::BasePool* before = from.saved && info->id < from.pools.size() ? from.pools[info->id].get() : nullptr;
+			const detail::BasePool* after = info->id < to.pools.size() ? to.pools[info->id].get() : nullptr;
+			poolsChanged |= !before || !after || before->stamp.load(std::memory_order_relaxed) != after->stamp.load(std::memory_order_relaxed);
+		}
+
+		std::vector<bool> sameArchetypes(to.archetypes.size(), false);
+		for (std::size_t a = 0; from.saved && !poolsChanged && a < std::min(from.archetypes.size(), to.archetypes.size()); a++)
+		{
+			const detail::ArchetypeImage* before = from.archetypes[a].get();
+			const detail::ArchetypeImage* after = to.archetypes[a].get();
+			if (before && after && before->rows == after->rows)
+			{
+				std::size_t chunks = after->rows ? (after->rows - 1) / after->capacity + 1 : 0;
+				sameArchetypes[a] = std::equal(after->versions.begin(), after->versions.begin() + chunks, before->versions.begin());
+			}
+		}
+
+		// Every entity lives in an archetype, if none changed there is nothing to walk
+		bool changed = !from.saved || poolsChanged;
+		for (std::size_t a = 0; !changed && a < std::max(from.archetypes.size(), to.archetypes.size()); a++)
+		{
+			bool filled = (a < from.archetypes.size() && from.archetypes[a] && from.archetypes[a]->rows > 0) ||
+				(a < to.archetypes.size() && to.archetypes[a] && to.archetypes[a]->rows > 0);
+			changed = filled && (a >= sameArchetypes.size() || !sameArchetypes[a]);
+		}
+
+		auto valueOf = [](const SceneState& state, const detail::EntitySlot& slot, const detail::ArchetypeImage* image, std::uint32_t index, const detail::ComponentInfo* info) -> const unsigned char* {
+			if (info->makePool)
+			{
+				const detail::BasePool& pool = *state.pools[info->id];
+				return static_cast<const unsigned char*>(pool.values()) + pool.position(index) * info->size;
+			}
+			std::size_t column = slot.archetype->column(info->id);
+			return image->chunks[slot.row / image->capacity] + image->offsets[column] + (slot.row % image->capacity) * info->size;
+		};
+
+		detail::ComponentTable table;
+		SnapshotWriter records;
+		SnapshotWriter changes;
+		SnapshotWriter before;
+		SnapshotWriter after;
+		std::size_t recordCount = 0;
+		std::size_t changeCount = 0;
+		std::uint32_t previous = 0;
+
+		// Value of a component added, or changed if 'old' is set, nothing if it did not change
+		// Components only make it to the table once they are written
+		auto change = [&](const detail::ComponentInfo* info, const unsigned char* old, const unsigned char* value) {
+			if (old && info->raw && std::memcmp(old, value, info->size) == 0)
+			{
+				return;
+			}
+
+			if (info->raw)
+			{
+				changes.writeVarint(std::uint64_t(table.indexOf(info)) << 2 | (old ? detail::DeltaChanged : detail::DeltaAdded));
+				detail::writeXor(changes, old, value, info->size);
+			}
+			else
+			{
+				after.clear();
+				info->save(after, value);
+				if (old)
+				{
+					before.clear();
+					info->save(before, old);
+					if (before.bytes() == after.bytes())
+					{
+						return;
+					}
+				}
+				changes.writeVarint(std::uint64_t(table.indexOf(info)) << 2 | (old ? detail::DeltaChanged : detail::DeltaAdded));
+				changes.writeVarint(after.bytes().size());
+				changes.write(after.bytes().data(), after.bytes().size());
+			}
+			changeCount++;
+		};
+
+		auto record = [&](std::uint32_t index, std::uint32_t kind) {
+			records.writeVarint(index - previous);
+			records.writeVarint(kind);
+			previous = index;
+			recordCount++;
+		};
+
+		std::size_t slotCount = changed ? std::max(from.saved ? from.slots.size() : 0, to.slots.size()) : 0;
+		for (std::uint32_t index = 0; index < slotCount; index++)
+		{
+			const detail::EntitySlot* old = from.saved && index < from.slots.size() && from.slots[index].archetype ? &from.slots[index] : nullptr;
+			const detail::EntitySlot* now = index < to.slots.size() && to.slots[index].archetype ? &to.slots[index] : nullptr;
+			if (old && now && old->archetype == now->archetype && old->generation == now->generation && sameArchetypes[now->archetype->index])
+			{
+				continue;
+			}
+			if (old && (!now || old->generation != now->generation))
+			{
+				record(index, detail::DeltaDestroy);
+				records.writeVarint(old->generation);
+				old = nullptr;
+			}
+
+			if (!now)
+			{
+				continue;
+			}
+
+			changes.clear();
+			changeCount = 0;
+			const detail::Signature& signature = to.signatures[index];
+			const detail::ArchetypeImage* image = imageOf(to, *now);
+			const detail::ArchetypeImage* oldImage = old ? imageOf(from, *old) : nullptr;
+
+			// Rows of chunks copied at the same stamp did not change
+			std::size_t chunk = now->row / image->capacity;
+			bool sameRows = old && old->archetype == now->archetype && old->row == now->row && oldImage->versions[chunk] == image->versions[chunk];
+			if (!sameRows)
+			{
+				for (const detail::ComponentInfo* info : now->archetype->components)
+				{
+					if (table.accepts(info))
+					{
+						bool had = old && from.signatures[index].test(info->id);
+						change(info, had ? valueOf(from, *old, oldImage, index, info) : nullptr, valueOf(to, *now, image, index, info));
+					}
+				}
+			}
+
+			for (const detail::ComponentInfo* info : pooled)
+			{
+				if (!signature.test(info->id) || !table.accepts(info))
+				{
+					continue;
+				}
+
+				bool had = old && from.signatures[index].test(info->id);
+				if (!had || from.pools[info->id]->stamp.load(std::memory_order_relaxed) != to.pools[info->id]->stamp.load(std::memory_order_relaxed))
+				{
+					change(info, had ? valueOf(from, *old, oldImage, index, info) : nullptr, valueOf(to, *now, image, index, info));
+				}
+			}
+
+			if (old)
+			{
+				// Removed, archetype components of the old archetype and pooled ones
+				auto removed = [&](const detail::ComponentInfo* info) {
+					if (!signature.test(info->id) && table.accepts(info))
+					{
+						changes.writeVarint(std::uint64_t(table.indexOf(info)) << 2 | detail::DeltaRemoved);
+						changeCount++;
+					}
+				};
+
+				for (const detail::ComponentInfo* info : old->archetype->components)
+				{
+					removed(info);
+				}
+
+				for (const detail::ComponentInfo* info : pooled)
+				{
+					if (from.signatures[index].test(info->id))
+					{
+						removed(info);
+					}
+				}
+			}
+
+			if (!old || changeCount > 0)
+			{
+				record(index, old ? detail::DeltaUpdate : detail::DeltaCreate);
+				if (!old)
+				{
+					records.writeVarint(now->generation);
+				}
+				records.writeVarint(changeCount);
+				records.write(changes.bytes().data(), changes.bytes().size());
+			}
+		}
+
+		writer.write(detail::deltaMagic, sizeof(detail::deltaMagic));
+		writer.writeVarint(detail::deltaVersion);
+		writer.write(detail::snapshotByteOrder);
+		writer.writeVarint(table.infos.size());
+		writer.writeVarint(to.slots.size());
+		writer.writeVarint(recordCount);
+		for (const detail::ComponentInfo* info : table.infos)
+		{
+			writer.writeString(info->name);
+			writer.writeVarint(info->size);
+			writer.writeVarint(info->raw ? detail::snapshotRaw : 0u);
+		}
+		writer.write(records.bytes().data(), records.bytes().size());
+		return true;
+	}
+
+	inline bool Scene::applyDelta(const void* data, std::size_t size)
+	{
+		FCS_TRACE_SCOPE("Scene::applyDelta", "state");
+		SnapshotReader reader(data, size);
+		const unsigned char* magic = reader.skip(sizeof(detail::deltaMagic));
+		std::uint64_t version = reader.readVarint();
+		std::uint32_t byteOrder = reader.read<std::uint32_t>();
+		if (!magic || std::memcmp(magic, detail::deltaMagic, sizeof(detail::deltaMagic)) != 0 || version != detail::deltaVersion || byteOrder != detail::snapshotByteOrder)
+		{
+			return false;
+		}
+
+		std::uint64_t componentCount = reader.readVarint();
+		std::uint64_t slotCount = reader.readVarint();
+		std::uint64_t recordCount = reader.readVarint();
+		if (slotCount > std::numeric_limits<std::uint32_t>::max())
+		{
+			return false;
+		}
+
+		// Components of this program matching the table, nullptr for the ones skipped
+		std::vector<const detail::ComponentInfo*> components;
+		std::vector<std::pair<std::size_t, bool>> layouts; // Size and raw flag of the table, to skip values
+		for (std::uint64_t i = 0; i < componentCount && !reader.failed(); i++)
+		{
+			std::string name = reader.readString();
+			std::uint64_t size = reader.readVarint();
+			bool raw = (reader.readVarint() & detail::snapshotRaw) != 0;
+			if (size > std::numeric_limits<std::uint32_t>::max())
+			{
+				return false;
+			}
+
+			auto found = detail::componentRegistry().find(name);
+			const detail::ComponentInfo* info = found != detail::componentRegistry().end() ? found->second : nullptr;
+			if (info && (raw ? !info->raw || info->size != size : !info->load))
+			{
+				info = nullptr;
+			}
+			components.push_back(info);
+			layouts.emplace_back(static_cast<std::size_t>(size), raw);
+		}
+
+		// Records read and checked, their changes are read again once the whole delta is
+		struct Record
+		{
+			std::uint32_t index;
+			std::uint32_t kind;
+			std::uint32_t generation; // Created or destroyed
+			const unsigned char* changes;
+			std::size_t bytes;
+		};
+
+		// Each record takes two bytes at least
+		std::vector<Record> records;
+		records.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(recordCount, reader.remaining() / 2)));
+
+		// Serialized values are loaded apart, in the order they come
+		std::vector<std::unique_ptr<detail::LoadedValues>> loaded;
+
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		std::uint64_t index = 0;
+		for (std::uint64_t r = 0; r < recordCount && !reader.failed(); r++)
+		{
+			std::uint64_t step = reader.readVarint();
+			std::uint64_t kind = reader.readVarint();
+			if (step >= slotCount - index || kind > detail::DeltaDestroy)
+			{
+				return false;
+			}
+			index += step;
+
+			// A slot comes once, or twice when destroyed then recycled
+			if (!records.empty() && step == 0 && (records.back().kind != detail::DeltaDestroy || kind == detail::DeltaDestroy))
+			{
+				return false;
+			}
+
+			Record record{ static_cast<std::uint32_t>(index), static_cast<std::uint32_t>(kind), 0, nullptr, 0 };
+			if (kind != detail::DeltaUpdate)
+			{
+				std::uint64_t generation = reader.readVarint();
+				if (generation == 0 || generation >= CommandBuffer::pendingGeneration)
+				{
+					return false;
+				}
+				record.generation = static_cast<std::uint32_t>(generation);
+			}
+
+			std::size_t start = reader.remaining();
+			if (kind != detail::DeltaDestroy)
+			{
+				std::uint64_t changeCount = reader.readVarint();
+				for (std::uint64_t c = 0; c < changeCount && !reader.failed(); c++)
+				{
+					std::uint64_t key = reader.readVarint();
+					std::uint64_t column = key >> 2;
+					std::uint64_t op = key & 3;
+					if (column >= components.size() || op > detail::DeltaRemoved)
+					{
+						return false;
+					}
+
+					const detail::ComponentInfo* info = components[column];
+					if (op == detail::DeltaRemoved)
+					{
+						continue;
+					}
+
+					if (layouts[column].second)
+					{
+						detail::readXor(reader, nullptr, layouts[column].first);
+						continue;
+					}
+
+					std::uint64_t length = reader.readVarint();
+					const unsigned char* serialized = reader.skip(static_cast<std::size_t>(length));
+					if (info && serialized)
+					{
+						SnapshotReader values(serialized, static_cast<std::size_t>(length));
+						loaded.push_back(std::make_unique<detail::LoadedValues>(info, 1));
+						if (!loaded.back()->load(values) || values.remaining() != 0)
+						{
+							return false;
+						}
+					}
+				}
+			}
+			record.changes = bytes + (size - start);
+			record.bytes = start - reader.remaining();
+			records.push_back(record);
+		}
+
+		if (reader.failed())
+		{
+			return false;
+		}
+
+		// Whether the records fit the slots as they are now, following a recycled slot through its destruction
+		// Destroying an entity already gone is fine, creating needs a free slot and a generation not older than its next one
+		auto fits = [&]() {
+			for (std::size_t r = 0; r < records.size(); r++)
+			{
+				const Record& record = records[r];
+				std::uint32_t i = record.index;
+				bool recycled = r > 0 && records[r - 1].index == i;
+				bool alive = !recycled && i < slots.size() && slots[i].archetype != nullptr;
+				std::uint32_t generation = recycled ? nextGeneration(records[r - 1].generation) : i < slots.size() ? slots[i].generation : 1;
+				bool fit = false;
+				switch (record.kind)
+				{
+				case detail::DeltaDestroy:
+					fit = i < slots.size() && generation == (alive ? record.generation : nextGeneration(record.generation));
+					break;
+				case detail::DeltaCreate:
+					fit = !alive && static_cast<std::int32_t>(record.generation - generation) >= 0;
+					break;
+				default:
+					fit = alive;
+					break;
+				}
+
+				if (!fit)
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+
+		if (!fits())
+		{
+			return false;
+		}
+
+		// Handlers see the entities before anything changes, they may have changed the scene though
+		if (hasSubscribers<Event::EntityDestroyed>())
+		{
+			bool emitted = false;
+			for (const Record& record : records)
+			{
+				EntityId id{ record.index, record.generation };
+				if (record.kind == detail::DeltaDestroy && isAlive(id))
+				{
+					emit<Event::EntityDestroyed>({ Handle<Entity>(Entity(this, id)) });
+					emitted = true;
+				}
+			}
+
+			if (emitted && !fits())
+			{
+				return false;
+			}
+		}
+
+		std::vector<EntityId> created;
+		std::size_t nextLoaded = 0;
+		for (const Record& record : records)
+		{
+			std::uint32_t i = record.index;
+			if (record.kind == detail::DeltaDestroy)
+			{
+				EntityId id{ i, record.generation };
+				if (isAlive(id))
+				{
+					releaseRow(id);
+					releaseId(id);
+				}
+				continue;
+			}
+
+			if (record.kind == detail::DeltaCreate)
+			{
+				if (i >= slots.size())
+				{
+					for (std::uint32_t gap = static_cast<std::uint32_t>(slots.size()); gap < i; gap++)
+					{
+						freeSlots.push_back(gap);
+					}
+					slots.resize(i + 1);
+					signatures.resize(i + 1);
+				}
+				else
+				{
+					// Free as checked, recently freed slots are at the back
+					freeSlots.erase(std::next(std::find(freeSlots.rbegin(), freeSlots.rend(), i)).base());
+				}
+
+				EntityId id{ i, record.generation };
+				detail::EntitySlot& slot = slots[i];
+				slot.generation = record.generation;
+				slot.archetype = root;
+				slot.row = root->allocate(id);
+				signatures[i] = detail::Signature();
+				for (auto query : activeQueries)
+				{
+					query->add(id, signatures[i]);
+				}
+				created.push_back(id);
+			}
+
+			// Read fine the first time
+			SnapshotReader changes(record.changes, record.bytes);
+			EntityId id{ i, slots[i].generation };
+			detail::Signature signature = signatures[i];
+			std::uint64_t changeCount = changes.readVarint();
+			for (std::uint64_t c = 0; c < changeCount; c++)
+			{
+				std::uint64_t key = changes.readVarint();
+				std::uint64_t column = key >> 2;
+				std::uint64_t op = key & 3;
+				const detail::ComponentInfo* info = components[column];
+				bool had = info && signature.test(info->id);
+				if (op == detail::DeltaRemoved)
+				{
+					if (had)
+					{
+						if (info->makePool)
+						{
+							getPool(info)->remove(i);
+						}
+						else
+						{
+							moveEntity(id, getArchetypeWithout(slots[i].archetype, info->id));
+						}
+						signature.reset(info->id);
+					}
+					continue;
+				}
+
+				unsigned char* value = nullptr;
+				if (info)
+				{
+					if (!had)
+					{
+						if (info->makePool)
+						{
+							getPool(info)->emplace(i);
+						}
+						else
+						{
+							moveEntity(id, getArchetypeWith(slots[i].archetype, info));
+						}
+						signature.set(info->id);
+					}
+
+					if (info->makePool)
+					{
+						detail::BasePool* pool = getPool(info);
+						pool->touch();
+						value = static_cast<unsigned char*>(pool->find(i));
+					}
+					else
+					{
+						const detail::EntitySlot& slot = slots[i];
+						slot.archetype->touchRow(slot.row);
+						value = static_cast<unsigned char*>(slot.archetype->get(slot.archetype->column(info->id), slot.row));
+					}
+				}
+
+				if (layouts[column].second)
+				{
+					if (value && (op == detail::DeltaAdded || !had))
+					{
+						std::memset(value, 0, info->size);
+					}
+					detail::readXor(changes, value, layouts[column].first);
+				}
+				else
+				{
+					changes.skip(static_cast<std::size_t>(changes.readVarint()));
+					if (value)
+					{
+						detail::LoadedValues& values = *loaded[nextLoaded++];
+						info->assign(value, values.at(0));
+						values.release();
+					}
+				}
+			}
+
+			if (!(signature == signatures[i]))
+			{
+				setSignature(id, signature);
+			}
+		}
+
+		if (hasSubscribers<Event::EntityCreated>())
+		{
+			for (EntityId id : created)
+			{
+				if (isAlive(id))
+				{
+					emit<Event::EntityCreated>({ Handle<Entity>(Entity(this, id)) });
+				}
+			}
+		}
+		return true;
+	}
+
+	template<typename T>
+	inline void Scene::enqueue(const T& event)
+	{
+		std::size_t id = getEventId<T>();
+		detail::ThreadEvents& thread = getThreadEvents();
+		if (id >= thread.queues.size())
+		{
+			thread.queues.resize(id + 1);
+		}
+
+		if (!thread.queues[id])
+		{
+			thread.queues[id] = std::make_unique<detail::EventQueue<T>>();
+
+			// First time this thread queues the type, make sure the scene has a queue to merge into
+			std::lock_guard<std::mutex> lock(threadEventsMutex);
+			if (id >= eventQueues.size())
+			{
+				eventQueues.resize(id + 1);
+			}
+
+			if (!eventQueues[id])
+			{
+				eventQueues[id] = std::make_unique<detail::EventQueue<T>>();
+			}
+		}
+
+		auto* queue = static_cast<detail::EventQueue<T>*>(thread.queues[id].get());
+		if (queue->events.empty())
+		{
+			thread.queued.push_back(id);
+		}
+
+		detail::EventKey& order = detail::eventOrder();
+		if (queue->runs.empty() || queue->runs.back().key.system != order.system || queue->runs.back().key.segment != order.segment)
+		{
+			queue->runs.push_back({ { order.system, order.segment, order.sequence++ }, queue->events.size() });
+		}
+		queue->events.push_back(event);
+	}
+
+	inline void Scene::flushEvents()
+	{
+		for (auto& channel : eventChannels)
+		{
+			if (channel)
+			{
+				channel->publish();
+			}
+		}
+
+		while (true)
+		{
+			flushingEvents.clear();
+			{
+				std::lock_guard<std::mutex> lock(threadEventsMutex);
+				for (auto& thread : threadEvents)
+				{
+					for (std::size_t id : thread->queued)
+					{
+						const auto& runs = thread->queues[id]->runs;
+						auto first = std::min_element(runs.begin(), runs.end(), [](const detail::EventRun& a, const detail::EventRun& b) { return a.key < b.key; });
+						flushingEvents.emplace_back(first->key, id);
+					}
+					thread->queued.clear();
+				}
+			}
+
+			if (flushingEvents.empty())
+			{
+				break;
+			}
+
+			// One entry per type with its earliest key, then types by that key
+			std::sort(flushingEvents.begin(), flushingEvents.end(), [](const auto& a, const auto& b) { return a.second != b.second ? a.second < b.second : a.first < b.first; });
+			flushingEvents.erase(std::unique(flushingEvents.begin(), flushingEvents.end(), [](const auto& a, const auto& b) { return a.second == b.second; }), flushingEvents.end());
+			std::sort(flushingEvents.begin(), flushingEvents.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+			// Handlers may queue more while these go out, those are picked up by the next pass
+			std::vector<std::pair<detail::EventKey, std::size_t>> flushing;
+			flushing.swap(flushingEvents);
+			for (const auto& entry : flushing)
+			{
+				eventQueues[entry.second]->dispatch(this);
+			}
+			flushing.clear();
+			flushingEvents.swap(flushing);
 		}
 	}
 
-	inline Handle<Entity> Scene::instantiate(Handle<Entity> copy)
+	template<typename T>
+	inline void detail::EventQueue<T>::dispatch(Scene* scene)
 	{
-		if (copy.expired())
+		std::size_t id = getEventId<T>();
+
+		// Detach the events of every thread
+		sources.clear();
 		{
-			auto ent = std::make_shared<Entity>();
-			entities.push_back(ent);
-			emit<Event::EntityCreated>({ Handle<Entity>(ent) });
-			return Handle<Entity>(*(entities.end() - 1));
+			std::lock_guard<std::mutex> lock(scene->threadEventsMutex);
+			for (auto& thread : scene->threadEvents)
+			{
+				if (id < thread->queues.size() && thread->queues[id])
+				{
+					auto* queue = static_cast<EventQueue<T>*>(thread->queues[id].get());
+					if (!queue->events.empty())
+					{
+						std::swap(queue->events, queue->dispatching);
+						std::swap(queue->runs, queue->dispatchingRuns);
+						sources.push_back(queue);
+					}
+				}
+			}
 		}
-		else
+
+		if (sources.empty())
 		{
-			auto ent = std::make_shared<Entity>(*copy.data.lock().get());
-			entities.push_back(ent);
-			emit<Event::EntityCreated>({ Handle<Entity>(ent) });
-			return Handle<Entity>(*(entities.end() - 1));
+			return;
 		}
-	}
 
-	inline void Scene::destroy(Handle<Entity> value)
-	{
-		using It = std::vector<std::shared_ptr<Entity>>::iterator;
-		std::shared_ptr<Entity> newValue = value.data.lock();;
-		
+		auto byKey = [](const EventRun& a, const EventRun& b) { return a.key < b.key; };
+		const auto& runs = sources[0]->dispatchingRuns;
 
-		for (It it = entities.begin(); it != entities.end(); it++)
+		// A single thread queues in key order unless it ran several systems or ranges, then the events go out as they are
+		if (sources.size() == 1 && std::is_sorted(runs.begin(), runs.end(), byKey))
+		{
+			scene->dispatchBatch<T>(Span<const T>(sources[0]->dispatching.data(), sources[0]->dispatching.size()));
+		}
+		else
 		{
-			if (*it == newValue)
+			order.clear();
+			for (EventQueue<T>* queue : sources)
+			{
+				for (std::size_t i = 0; i < queue->dispatchingRuns.size(); i++)
+				{
+					std::size_t begin = queue->dispatchingRuns[i].begin;
+					std::size_t end = i + 1 < queue->dispatchingRuns.size() ? queue->dispatchingRuns[i + 1].begin : queue->dispatching.size();
+					order.emplace_back(queue->dispatchingRuns[i].key, Span<const T>(queue->dispatching.data() + begin, end - begin));
+				}
+			}
+			std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+			// Copied out, subscribers may queue this type again while the batch is handled
+			std::vector<T> batch;
+			batch.swap(events);
+			for (const auto& entry : order)
 			{
-				emit<Event::EntityDestroyed>({ Handle<Entity>(*it) });
-				// This calls the dtor
-				entities.erase(it);
+				batch.insert(batch.end(), entry.second.begin(), entry.second.end());
 			}
+			scene->dispatchBatch<T>(Span<const T>(batch.data(), batch.size()));
+			batch.clear();
+			events.swap(batch);
 		}
-	}
 
-	inline std::vector<Handle<Entity>> Scene::getAll()
-	{
-		std::vector<Handle<Entity>> ret;
-		ret.reserve(entities.size());
-		for (auto ent : entities)
+		for (EventQueue<T>* queue : sources)
 		{
-			ret.push_back(Handle<Entity>(ent));
+			queue->dispatching.clear();
+			queue->dispatchingRuns.clear();
 		}
-		return ret;
 	}
 
-	template<typename ...Types>
-	inline std::vector<Handle<Entity>> Scene::getAllWith()
+	template<typename T>
+	inline void Scene::dispatchBatch(Span<const T> events)
 	{
-		std::vector<Handle<Entity>> ret;
-		for (auto ent : entities)
+		std::size_t id = getEventId<T>();
+		FCS_TRACE_SCOPE(detail::typeName<T>().c_str(), "event");
+#ifdef FCS_PROFILING
+		auto start = std::chrono::steady_clock::now();
+#endif
+		if (id < eventChannels.size() && eventChannels[id])
+		{
+			static_cast<detail::EventChannel<T>*>(eventChannels[id].get())->append(events);
+		}
+
+		if (id < subscribers.size())
 		{
-			if (ent->has<Types...>())
+			for (std::size_t i = 0, count = subscribers[id].slots.size(); i < count; i++)
 			{
-				ret.push_back(Handle<Entity>(ent));
+				if (Subscriber* base = subscribers[id].slots[i])
+				{
+					static_cast<EventSubscriber<T>*>(base)->onEventBatch(this, events);
+				}
 			}
 		}
-		return ret;
-	}
-
-	template<typename T>
-	inline Handle<T> Entity::addComponent()
-	{
-		auto shared = std::make_shared<T>();
-		components.emplace(getType<T>(), shared);
-		return Handle<T>(shared);
+#ifdef FCS_PROFILING
+		profileEvent<T>(id, start);
+#endif
 	}
 
+#ifdef FCS_PROFILING
 	template<typename T>
-	inline void Entity::removeComponent()
-	{
-		if(components.find(getType<T>()) != components.end())
-			components.erase(getType<T>());
-	}
-	template<typename T>
-	inline Handle<T> Entity::getComponent()
+	inline void Scene::profileEvent(std::size_t id, std::chrono::steady_clock::time_point start)
 	{
-		auto it = components.find(getType<T>());
-		if (it != components.end())
+		// emit runs on any thread, each one only writes its own profiles
+		std::vector<detail::Profile>& profiles = getThreadEvents().profiles;
+		if (id >= profiles.size())
 		{
-			// Need a dynamic cast to derived here
-			auto derived = std::dynamic_pointer_cast<T>(it->second);
-			return Handle<T>(derived);
+			profiles.resize(id + 1);
 		}
-		return Handle<T>();
-	}
-
-	template<typename T>
-	inline bool Entity::has()
-	{
-		return components.find(getType<T>()) != components.end();
-	}
-
-	template<typename T, typename U, typename... Args>
-	inline bool Entity::has()
-	{
-		return has<T>() && has<U, Args...>();
-	}
 
-#ifndef SYSTEM_NOHANDLE
-	template<typename System>
-	inline Handle<System> Scene::createSystem()
-	{
-		auto shared = std::make_shared<System>();
-		systems.emplace(getType<System>(), shared);
-		shared->internal_initialize(this);
-		return Handle<System>(shared);
-	}
-#else
-	template<typename System>
-	inline void Scene::createSystem()
-	{
-		auto shared = std::make_shared<System>();
-		systems.emplace(getType<System>(), shared);
-		shared->internal_initialize(this);
+		detail::Profile& profile = profiles[id];
+		if (profile.name.empty())
+		{
+			profile.name = detail::typeName<T>();
+		}
+		profile.record(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
 	}
 #endif
 
-	template<typename System>
-	inline void Scene::deleteSystem()
+	inline SceneStats Scene::stats() const
 	{
-		auto found = systems.find(getType<System>());
-		if (found != systems.end())
+		SceneStats result;
+		result.entities = slots.size() - freeSlots.size();
+		result.memory = memory.stats();
+#ifdef FCS_PROFILING
+		for (auto& system : schedule)
 		{
-			found->second->internal_deinitialize(this);
-			systems.erase(getType<System>());
+			if (system->isActive)
+			{
+				const detail::SystemProfile& profile = system->profile;
+				result.systems.push_back({ profile.name, profile.calls, profile.entities, profile.totalEntities, profile.total, profile.time.summary() });
+			}
 		}
-	}
 
-	template<typename T>
-	inline void Scene::emit(const T& event)
-	{
-		auto found = subscribers.find(getType<T>());
-		if (found != subscribers.end())
+		// Events by id over the profiles of every thread
+		std::vector<detail::Profile> events;
+		{
+			std::lock_guard<std::mutex> lock(threadEventsMutex);
+			for (auto& thread : threadEvents)
+			{
+				for (std::size_t id = 0; id < thread->profiles.size(); id++)
+				{
+					const detail::Profile& profile = thread->profiles[id];
+					if (profile.calls == 0)
+					{
+						continue;
+					}
+
+					if (id >= events.size())
+					{
+						events.resize(id + 1);
+					}
+					events[id].name = profile.name;
+					events[id].calls += profile.calls;
+					events[id].total += profile.total;
+					events[id].time.merge(profile.time);
+				}
+			}
+		}
+
+		for (auto& profile : events)
 		{
-			for (auto base : found->second)
+			if (profile.calls > 0)
 			{
-				auto* sub = reinterpret_cast<EventSubscriber<T>*>(base);
-				sub->onEvent(this, event);
+				result.events.push_back({ profile.name, profile.calls, profile.total, profile.time.summary() });
 			}
 		}
+#endif
+		return result;
 	}
 
 	template<typename... Events>
 	inline void System<Events...>::internal_initialize(Scene* scene)
 	{
 		// Subscribe to templated events
-		call_subscribe<Events...>(scene);
+		(call_subscribe<Events>(scene), ...);
 
 		// User defined initialize
 		initialize(scene);
@@ -509,52 +6589,137 @@ namespace FCS
 		deinitialize(scene);
 
 		// Unsubscribe to templated events
-		call_unsubscribe<Events...>(scene);
+		(call_unsubscribe<Events>(scene), ...);
 	}
 
 	template<typename Evt>
 	inline void EventSubscriber<Evt>::subscribe(Scene* scene)
 	{
-		auto found = scene->subscribers.find(getType<Evt>());
-		if (found != scene->subscribers.end())
+		std::size_t id = getEventId<Evt>();
+		if (id >= scene->subscribers.size())
+		{
+			scene->subscribers.resize(id + 1);
+		}
+
+		detail::SubscriberSlots& list = scene->subscribers[id];
+		if (!list.free.empty())
 		{
-			found->second.push_back(this);
+			slot = list.free.back();
+			list.free.pop_back();
+			list.slots[slot] = this;
 		}
 		else
 		{
-			scene->subscribers.insert({ getType<Evt>(), { this } });
+			slot = list.slots.size();
+			list.slots.push_back(this);
 		}
+		list.count++;
 	}
 
 	template<typename Evt>
 	inline void EventSubscriber<Evt>::unsubscribe(Scene* scene)
 	{
-		auto found = scene->subscribers.find(getType<Evt>());
-		if (found != scene->subscribers.end())
+		std::size_t id = getEventId<Evt>();
+		if (id < scene->subscribers.size())
 		{
-			for (unsigned int i = 0; i < found->second.size(); i++)
+			detail::SubscriberSlots& list = scene->subscribers[id];
+			if (slot < list.slots.size() && list.slots[slot] == this)
 			{
-				if (this == found->second[i])
-				{
-					found->second.erase(found->second.begin() + i);
-				}
+				list.slots[slot] = nullptr;
+				list.free.push_back(slot);
+				list.count--;
 			}
-			if (found->second.size() == 0)
+		}
+		slot = ~std::size_t(0);
+	}
+
+	inline void SceneManager::Tick()
+	{
+		FCS_TRACE_SCOPE("SceneManager::Tick", "frame");
+		SceneManager& sm = Instance();
+		auto now = std::chrono::steady_clock::now();
+		double elapsed = sm.ticking ? std::chrono::duration<double>(now - sm.lastTick).count() : 0.0;
+		sm.lastTick = now;
+		sm.ticking = true;
+
+		if (sm.scenes.empty())
+		{
+			sm.accumulator = 0.0;
+			return;
+		}
+
+		Scene* scene = sm.scenes.top().get();
+		const LoopSettings& settings = sm.settings;
+		sm.accumulator += elapsed;
+
+		std::size_t steps = 0;
+		while (sm.accumulator >= settings.fixedStep && steps < settings.maxSteps)
+		{
+			scene->internal_update(static_cast<float>(settings.fixedStep), Phase::PreUpdate, Phase::PostUpdate);
+			sm.accumulator -= settings.fixedStep;
+			steps++;
+		}
+
+		// Could not catch up, keep only the partial step
+		if (sm.accumulator >= settings.fixedStep)
+		{
+			sm.accumulator = std::fmod(sm.accumulator, settings.fixedStep);
+		}
+
+		scene->internal_update(static_cast<float>(elapsed), Phase::RenderExtract, Phase::RenderExtract);
+		if (settings.render)
+		{
+			FCS_TRACE_SCOPE("Render", "frame");
+			settings.render(sm.accumulator / settings.fixedStep, elapsed);
+		}
+	}
+
+	inline void SceneManager::Run()
+	{
+		SceneManager& sm = Instance();
+		sm.running = true;
+		sm.ticking = false;
+		sm.accumulator = 0.0;
+
+		while (sm.running && !sm.scenes.empty())
+		{
+			auto start = std::chrono::steady_clock::now();
+			Tick();
+
+			if (sm.settings.frameTime > 0.0)
 			{
-				scene->subscribers.erase(found);
+				// Sleep is coarse on some platforms, so stop a bit early and yield the rest
+				auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(sm.settings.frameTime));
+				std::this_thread::sleep_until(deadline - std::chrono::milliseconds(2));
+				while (std::chrono::steady_clock::now() < deadline)
+				{
+					std::this_thread::yield();
+				}
 			}
 		}
+		sm.running = false;
+	}
+
+	inline void SceneManager::Stop()
+	{
+		Instance().running = false;
+	}
+
+	inline void SceneManager::SetLoopSettings(const LoopSettings& settings)
+	{
+		assert(settings.fixedStep > 0.0 && "LoopSettings::fixedStep must be above 0.");
+		Instance().settings = settings;
 	}
 
-	inline void SceneManager::update()
+	inline const LoopSettings& SceneManager::GetLoopSettings()
 	{
-		//FIX: Use clock instead of the constant 0 placeholder in delta time
-		scenes.top()->internal_update(0);
+		return Instance().settings;
 	}
 
 	template<typename Scene>
 	inline void SceneManager::LoadScene(bool unloadLast)
 	{
+		FCS_TRACE_SCOPE("SceneManager::LoadScene", "scene");
 		SceneManager& sm = Instance();
 		if (unloadLast && !sm.scenes.empty())
 		{
@@ -570,6 +6735,7 @@ namespace FCS
 
 	inline void SceneManager::UnloadScene()
 	{
+		FCS_TRACE_SCOPE("SceneManager::UnloadScene", "scene");
 		SceneManager& sm = Instance();
 		if (!sm.scenes.empty())
 		{
@@ -665,6 +6831,7 @@ namespace resource_loader
 			uint32 width;
 			uint32 height;
 			uint32 channels;
+			FCS::detail::MappedFile* mapping = nullptr; // Set when data points into a mapped file, released with the image
 		};
 
 		inline static Image allocateImage(uint32 w, uint32 h, uint32 channels)
@@ -683,7 +6850,17 @@ namespace resource_loader
 
 		inline static void deallocateImg(Image* img)
 		{
-			if (img->data != nullptr)
+			if (img->mapping != nullptr)
+			{
+				delete img->mapping;
+				img->mapping = nullptr;
+				img->data = nullptr;
+				img->size = 0;
+				img->width = 0;
+				img->height = 0;
+				img->channels = 0;
+			}
+			else if (img->data != nullptr)
 			{
 				free(img->data);
 				img->size = 0;
@@ -742,6 +6919,7 @@ namespace resource_loader
 
 		inline static Image read32_24BMP(const char* file)
 		{
+			FCS_TRACE_SCOPE("read32_24BMP", "resource");
 			FileHeader fileH;
 			InfoHeader infoH;
 			ColorHeader colorH;
@@ -896,8 +7074,249 @@ namespace resource_loader
 			return Image(); // TODO: Handle error
 		}
 
+		// Where the pixels of a BMP are and how its rows are laid out
+		struct Layout
+		{
+			uint32 width;
+			uint32 height;
+			uint32 channels;
+			uint32 row_stride; // Bytes of pixels in a row
+			uint32 stride; // Bytes of a row in the file, padded to 4
+			uint32 offset_data;
+		};
+
+		// Validates the headers of a BMP of file_size bytes, the first header_size of them at data
+		// Takes uncompressed bottom up 24 bit images and BGRA 32 bit ones, all rows must be in the file
+		inline static bool readLayout(const byte* data, std::size_t header_size, uint64 file_size, Layout* layout)
+		{
+			FileHeader fileH;
+			InfoHeader infoH;
+			if (header_size < sizeof(FileHeader) + sizeof(InfoHeader))
+			{
+				return false;
+			}
+			std::memcpy(&fileH, data, sizeof(FileHeader));
+			std::memcpy(&infoH, data + sizeof(FileHeader), sizeof(InfoHeader));
+
+			if (fileH.file_type != 0x4D42 || infoH.size < sizeof(InfoHeader) || (infoH.depth != 24 && infoH.depth != 32))
+			{
+				return false;
+			}
+
+			// Top down images have a negative height
+			if (infoH.width == 0 || static_cast<int32>(infoH.height) <= 0)
+			{
+				return false;
+			}
+
+			bool masked = false;
+			if (infoH.depth == 32 && infoH.size >= sizeof(InfoHeader) + sizeof(ColorHeader))
+			{
+				ColorHeader colorH;
+				if (header_size < sizeof(FileHeader) + sizeof(InfoHeader) + sizeof(ColorHeader))
+				{
+					return false;
+				}
+				std::memcpy(&colorH, data + sizeof(FileHeader) + sizeof(InfoHeader), sizeof(ColorHeader));
+
+				// Check for the color specification - BGRA
+				masked = colorH.red_mask == 0x00ff0000 && colorH.green_mask == 0x0000ff00 && colorH.blue_mask == 0x000000ff && colorH.alpha_mask == 0xff000000;
+				if (!masked)
+				{
+					return false;
+				}
+			}
+
+			if (infoH.compression != 0 && !(infoH.compression == 3 && masked))
+			{
+				return false;
+			}
+
+			uint64 row_stride = uint64(infoH.width) * (infoH.depth / 8);
+			uint64 stride = (row_stride + 3) & ~uint64(3);
+			if (stride > std::numeric_limits<uint32>::max() || fileH.offset_data > file_size || (file_size - fileH.offset_data) / stride < infoH.height)
+			{
+				return false;
+			}
+
+			layout->width = infoH.width;
+			layout->height = infoH.height;
+			layout->channels = infoH.depth / 8;
+			layout->row_stride = static_cast<uint32>(row_stride);
+			layout->stride = static_cast<uint32>(stride);
+			layout->offset_data = fileH.offset_data;
+			return true;
+		}
+
+		// Same image as read32_24BMP with the file mapped instead of read. When rows have no padding (32 bit images and
+		// 24 bit ones with a width multiple of 4) data points into the mapping, otherwise rows are copied once
+		// The mapping is copy on write, changes to data never reach the file. Release with deallocateImg
+		inline static Image map32_24BMP(const char* file)
+		{
+			FCS_TRACE_SCOPE("map32_24BMP", "resource");
+			FCS::detail::MappedFile* mapping = new FCS::detail::MappedFile(file, true);
+			Layout layout;
+			if (!mapping->valid() || !readLayout(mapping->data(), mapping->size(), mapping->size(), &layout))
+			{
+				delete mapping;
+				return Image();
+			}
+
+			Image i;
+			i.size = std::size_t(layout.row_stride) * layout.height;
+			i.width = layout.width;
+			i.height = layout.height;
+			i.channels = layout.channels;
+
+			const byte* pixels = mapping->data() + layout.offset_data;
+			if (layout.stride == layout.row_stride)
+			{
+				i.data = const_cast<byte*>(pixels);
+				i.mapping = mapping;
+				return i;
+			}
+
+			// Drop the row padding
+			i.data = (byte*)malloc(i.size);
+			for (uint32 y = 0; i.data && y < layout.height; y++)
+			{
+				std::memcpy(i.data + std::size_t(layout.row_stride) * y, pixels + std::size_t(layout.stride) * y, layout.row_stride);
+			}
+			delete mapping;
+			return i.data ? i : Image();
+		}
+
+		// Decodes a BMP a band of rows at a time, memory stays proportional to the band and the read window
+		// Rows come in the order read32_24BMP stores them (bottom up), packed without padding
+		struct BandReader
+		{
+			FILE* file;
+			Layout layout;
+			uint32 next_row; // Rows decoded so far
+			byte* window; // Padded rows go through here, unpadded ones are read straight into the band
+			size_t window_size;
+			bool failed; // Set when the file ends early or can not be read
+		};
+
+		inline static bool seekFile(FILE* f, uint64 offset, int origin)
+		{
+#ifdef _WIN32
+			return _fseeki64(f, static_cast<__int64>(offset), origin) == 0;
+#else
+			return fseeko(f, static_cast<off_t>(offset), origin) == 0;
+#endif
+		}
+
+		inline static uint64 tellFile(FILE* f)
+		{
+#ifdef _WIN32
+			__int64 position = _ftelli64(f);
+#else
+			off_t position = ftello(f);
+#endif
+			return position < 0 ? 0 : static_cast<uint64>(position);
+		}
+
+		// Validates the headers and leaves the file at the first row, false if it is not a BMP read32_24BMP takes
+		inline static bool openBands32_24BMP(const char* file, BandReader* reader, size_t window_size = 64 * 1024)
+		{
+			byte header[sizeof(FileHeader) + sizeof(InfoHeader) + sizeof(ColorHeader)];
+			*reader = BandReader();
+
+			FILE* f = fopen(file, "rb");
+			if (f == nullptr)
+			{
+				return false;
+			}
+
+			uint64 file_size = seekFile(f, 0, SEEK_END) ? tellFile(f) : 0;
+			size_t header_size = seekFile(f, 0, SEEK_SET) ? fread(header, sizeof(byte), sizeof(header), f) : 0;
+			if (!readLayout(header, header_size, file_size, &reader->layout) || !seekFile(f, reader->layout.offset_data, SEEK_SET))
+			{
+				fclose(f);
+				return false;
+			}
+
+			if (reader->layout.stride != reader->layout.row_stride)
+			{
+				reader->window_size = window_size > 0 ? window_size : 1;
+				reader->window = (byte*)malloc(reader->window_size * sizeof(byte));
+				if (reader->window == nullptr)
+				{
+					fclose(f);
+					return false;
+				}
+			}
+			reader->file = f;
+			return true;
+		}
+
+		// Decodes up to rows rows into band (rows * layout.row_stride bytes), returns how many, 0 once done or failed
+		inline static uint32 readBand(BandReader* reader, byte* band, uint32 rows)
+		{
+			FCS_TRACE_SCOPE("readBand", "resource");
+			if (reader->file == nullptr || reader->failed)
+			{
+				return 0;
+			}
+
+			const Layout& layout = reader->layout;
+			rows = std::min(rows, layout.height - reader->next_row);
+			if (layout.stride == layout.row_stride)
+			{
+				size_t bytes = size_t(layout.row_stride) * rows;
+				reader->failed = fread(band, sizeof(byte), bytes, reader->file) != bytes;
+			}
+			else
+			{
+				// Window sized reads, row bytes are copied out and the padding skipped
+				uint64 remaining = uint64(layout.stride) * rows;
+				uint32 column = 0;
+				while (remaining > 0 && !reader->failed)
+				{
+					size_t count = static_cast<size_t>(std::min<uint64>(reader->window_size, remaining));
+					reader->failed = fread(reader->window, sizeof(byte), count, reader->file) != count;
+					for (size_t k = 0; k < count && !reader->failed;)
+					{
+						uint32 end = column < layout.row_stride ? layout.row_stride : layout.stride;
+						uint32 take = static_cast<uint32>(std::min<size_t>(count - k, end - column));
+						if (column < layout.row_stride)
+						{
+							std::memcpy(band, reader->window + k, take);
+							band += take;
+						}
+						k += take;
+						column = (column + take) % layout.stride;
+					}
+					remaining -= count;
+				}
+			}
+
+			if (reader->failed)
+			{
+				return 0;
+			}
+			reader->next_row += rows;
+			return rows;
+		}
+
+		inline static void closeBands(BandReader* reader)
+		{
+			if (reader->file != nullptr)
+			{
+				fclose(reader->file);
+			}
+
+			if (reader->window != nullptr)
+			{
+				free(reader->window);
+			}
+			*reader = BandReader();
+		}
+
 		inline static bool write32_24BMP(const char* file, const Image* img)
 		{
+			FCS_TRACE_SCOPE("write32_24BMP", "resource");
 			FileHeader fileH;
 			InfoHeader infoH;
 
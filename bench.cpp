@@ -0,0 +1,773 @@
+// Benchmark file
+#include "FastECS.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+template<int N>
+class Tag : public FCS::Component
+{
+public:
+	float value;
+
+	static constexpr char Label[] = { 'T', 'a', 'g', static_cast<char>('0' + N), '\0' };
+	FCS_COMPONENT_AS(Tag, Label);
+};
+
+using Clock = std::chrono::steady_clock;
+
+static volatile std::size_t sink = 0;
+
+// Runs f 'iterations' times and returns the average cost in nanoseconds
+template<typename F>
+static double nsPerOp(std::size_t iterations, F f)
+{
+	auto start = Clock::now();
+	for (std::size_t i = 0; i < iterations; i++)
+	{
+		f(i);
+	}
+	auto end = Clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+static bool failed = false;
+
+// Results the benchmarks depend on, main fails if one did not hold
+static void check(bool ok, const char* what)
+{
+	if (!ok)
+	{
+		std::cout << "Check failed: " << what << std::endl;
+		failed = true;
+	}
+}
+
+template<int... N>
+static void benchTypeLookup(std::integer_sequence<int, N...>)
+{
+	const std::size_t iterations = 10000000;
+
+	// Before: RTTI type_index hashed into an unordered_map on every lookup
+	std::unordered_map<std::type_index, std::size_t> byType;
+	(byType.emplace(std::type_index(typeid(Tag<N>)), N), ...);
+
+	double before = nsPerOp(iterations, [&](std::size_t i)
+	{
+		std::size_t sum = 0;
+		((sum += byType.find(std::type_index(typeid(Tag<N>)))->second), ...);
+		sink = sum + i;
+	}) / sizeof...(N);
+
+	// After: dense component ids index straight into an array
+	std::vector<std::size_t> byId;
+	((byId.resize(std::max(byId.size(), FCS::getComponentId<Tag<N>>() + 1)), byId[FCS::getComponentId<Tag<N>>()] = N), ...);
+
+	double after = nsPerOp(iterations, [&](std::size_t i)
+	{
+		std::size_t sum = 0;
+		((sum += byId[FCS::getComponentId<Tag<N>>()]), ...);
+		sink = sum + i;
+	}) / sizeof...(N);
+
+	std::cout << "Type lookup (type_index map): " << before << " ns" << std::endl;
+	std::cout << "Type lookup (dense id array): " << after << " ns" << std::endl;
+}
+
+class BenchScene : public FCS::Scene
+{
+public:
+	void initialize() override { }
+	void deinitialize() override { }
+};
+
+static void benchEntityLookup()
+{
+	const std::size_t count = 100000;
+
+	BenchScene scene;
+	std::vector<FCS::Handle<FCS::Entity>> entities;
+	entities.reserve(count);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		auto ent = scene.instantiate();
+		ent->addComponent<Tag<0>>();
+		if (i % 2) ent->addComponent<Tag<1>>();
+		if (i % 3) ent->addComponent<Tag<2>>();
+		entities.push_back(ent);
+	}
+
+	double has = nsPerOp(count * 10, [&](std::size_t i)
+	{
+		sink = sink + entities[i % count]->has<Tag<1>>();
+	});
+
+	double get = nsPerOp(count * 10, [&](std::size_t i)
+	{
+		sink = sink + static_cast<std::size_t>(entities[i % count]->getComponent<Tag<0>>()->value);
+	});
+
+	std::cout << "Entity::has<T>():          " << has << " ns" << std::endl;
+	std::cout << "Entity::getComponent<T>(): " << get << " ns" << std::endl;
+}
+
+static void benchIteration()
+{
+	const std::size_t count = 500000;
+
+	BenchScene scene;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		auto ent = scene.instantiate();
+		ent->addComponent<Tag<0>>()->value = 1.0f;
+		ent->addComponent<Tag<1>>()->value = 2.0f;
+	}
+
+	double handles = nsPerOp(10, [&](std::size_t)
+	{
+		for (auto ent : scene.getAllWith<Tag<0>, Tag<1>>())
+		{
+			ent->getComponent<Tag<0>>()->value += ent->getComponent<Tag<1>>()->value;
+		}
+	}) / count;
+
+	double each = nsPerOp(10, [&](std::size_t)
+	{
+		scene.each<Tag<0>, Tag<1>>([](Tag<0>& a, const Tag<1>& b) { a.value += b.value; });
+	}) / count;
+
+	double view = nsPerOp(10, [&](std::size_t)
+	{
+		for (auto [id, a, b] : scene.view<Tag<0>, Tag<1>>())
+		{
+			a.value += b.value;
+		}
+	}) / count;
+
+	double parallel = nsPerOp(10, [&](std::size_t)
+	{
+		scene.parallelEach<Tag<0>, Tag<1>>([](Tag<0>& a, const Tag<1>& b) { a.value += b.value; });
+	}) / count;
+
+	std::cout << "Iterate getAllWith + getComponent: " << handles << " ns/entity" << std::endl;
+	std::cout << "Iterate Scene::each:               " << each << " ns/entity" << std::endl;
+	std::cout << "Iterate Scene::view:               " << view << " ns/entity" << std::endl;
+	std::cout << "Iterate Scene::parallelEach:       " << parallel << " ns/entity (" << FCS::detail::JobSystem::instance().size() << " threads)" << std::endl;
+}
+
+class SparseTag : public FCS::Component
+{
+public:
+	float value;
+
+	FCS_SPARSE_COMPONENT(SparseTag);
+};
+
+static void benchUnload()
+{
+	const std::size_t count = 1000000;
+
+	auto scene = std::make_unique<BenchScene>();
+	for (std::size_t i = 0; i < count; i++)
+	{
+		auto ent = scene->instantiate();
+		ent->addComponent<Tag<0>>();
+		if (i % 2) ent->addComponent<Tag<1>>();
+		if (i % 4 == 0) ent->addComponent<SparseTag>();
+	}
+
+	FCS::MemoryStats stats = scene->getMemoryStats();
+	double unload = nsPerOp(1, [&](std::size_t) { scene.reset(); }) / 1e6;
+
+	std::cout << "Scene memory: " << stats.reserved / 1024 << " KB reserved, " << stats.used / 1024 << " KB used" << std::endl;
+	std::cout << "Unload " << count << " entities: " << unload << " ms" << std::endl;
+}
+
+struct Spawned
+{
+	FCS::EntityId entity;
+};
+
+class SpawnCounter : public FCS::System<Spawned>
+{
+public:
+	void initialize(FCS::Scene* /*scene*/) override { }
+	void deinitialize(FCS::Scene* /*scene*/) override { }
+	void update(FCS::Scene* /*scene*/, float /*deltaTime*/) override { }
+
+	void onEvent(FCS::Scene* /*scene*/, const Spawned& event) override
+	{
+		sink = sink + event.entity.index;
+	}
+
+	void onEventBatch(FCS::Scene* /*scene*/, FCS::Span<const Spawned> events) override
+	{
+		std::size_t sum = 0;
+		for (const Spawned& event : events)
+		{
+			sum += event.entity.index;
+		}
+		sink = sink + sum;
+	}
+};
+
+class EventScene : public FCS::Scene
+{
+public:
+	void initialize() override { createSystem<SpawnCounter>(); }
+	void deinitialize() override { }
+};
+
+static std::vector<FCS::EntityId> spawnOrder;
+
+class SpawnRecorder : public FCS::System<Spawned>
+{
+public:
+	void initialize(FCS::Scene* /*scene*/) override { }
+	void deinitialize(FCS::Scene* /*scene*/) override { }
+	void update(FCS::Scene* /*scene*/, float /*deltaTime*/) override { }
+
+	void onEvent(FCS::Scene* /*scene*/, const Spawned& event) override
+	{
+		spawnOrder.push_back(event.entity);
+	}
+
+	void onEventBatch(FCS::Scene* /*scene*/, FCS::Span<const Spawned> events) override
+	{
+		for (const Spawned& event : events)
+		{
+			spawnOrder.push_back(event.entity);
+		}
+	}
+};
+
+class OrderScene : public FCS::Scene
+{
+public:
+	void initialize() override { createSystem<SpawnRecorder>(); }
+	void deinitialize() override { }
+};
+
+static void benchEvents()
+{
+	const std::size_t count = 50000;
+
+	EventScene scene;
+	scene.initialize();
+
+	double emit = nsPerOp(20, [&](std::size_t)
+	{
+		for (std::size_t i = 0; i < count; i++)
+		{
+			scene.emit(Spawned{ FCS::EntityId{ static_cast<std::uint32_t>(i), 0 } });
+		}
+	}) / count;
+
+	double enqueue = nsPerOp(20, [&](std::size_t)
+	{
+		for (std::size_t i = 0; i < count; i++)
+		{
+			scene.enqueue(Spawned{ FCS::EntityId{ static_cast<std::uint32_t>(i), 0 } });
+		}
+		scene.flushEvents();
+	}) / count;
+
+	// Events queued by parallelEach ranges are flushed in entity order whichever threads ran them, between the ones
+	// queued before and after by the calling thread
+	OrderScene ordered;
+	ordered.initialize();
+	for (std::size_t i = 0; i < count; i++)
+	{
+		ordered.instantiate()->addComponent<Tag<0>>();
+	}
+
+	FCS::EntityId before{ static_cast<std::uint32_t>(count), 0 };
+	FCS::EntityId after{ static_cast<std::uint32_t>(count + 1), 0 };
+	std::vector<FCS::EntityId> expected = { before };
+	ordered.each<Tag<0>>([&](FCS::EntityId id, Tag<0>& /*tag*/) { expected.push_back(id); });
+	expected.push_back(after);
+
+	double parallel = nsPerOp(1, [&](std::size_t)
+	{
+		ordered.enqueue(Spawned{ before });
+		ordered.parallelEach<Tag<0>>([&](FCS::EntityId id, Tag<0>& /*tag*/) { ordered.enqueue(Spawned{ id }); }, 256);
+		ordered.enqueue(Spawned{ after });
+		ordered.flushEvents();
+	}) / count;
+	check(spawnOrder == expected, "events queued from parallelEach are flushed in entity order");
+
+	std::cout << "Dispatch Scene::emit:               " << emit << " ns/event" << std::endl;
+	std::cout << "Dispatch Scene::enqueue + flush:    " << enqueue << " ns/event" << std::endl;
+	std::cout << "Dispatch enqueue from parallelEach: " << parallel << " ns/event" << std::endl;
+}
+
+class Position : public FCS::Component
+{
+public:
+	float x, y, z;
+
+	FCS_COMPONENT(Position);
+};
+
+class Velocity : public FCS::Component
+{
+public:
+	float x, y, z;
+
+	FCS_COMPONENT(Velocity);
+};
+
+template<typename T>
+static bool sameComponent(FCS::Handle<FCS::Entity>& a, FCS::Handle<FCS::Entity>& b)
+{
+	if (a->has<T>() != b->has<T>())
+	{
+		return false;
+	}
+
+	if (!a->has<T>())
+	{
+		return true;
+	}
+
+	FCS::Handle<T> x = a->getComponent<T>();
+	FCS::Handle<T> y = b->getComponent<T>();
+	return x->x == y->x && x->y == y->y && x->z == y->z;
+}
+
+// Whether both scenes hold the same entities, ids included, with the same positions and velocities
+static bool sameEntities(FCS::Scene& a, FCS::Scene& b)
+{
+	std::vector<FCS::Handle<FCS::Entity>> all = a.getAll();
+	if (all.size() != b.getAll().size())
+	{
+		return false;
+	}
+
+	for (FCS::Handle<FCS::Entity>& entity : all)
+	{
+		FCS::Handle<FCS::Entity> other = b.getEntity(entity.getId());
+		if (other.expired() || !sameComponent<Position>(entity, other) || !sameComponent<Velocity>(entity, other))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void benchCommands()
+{
+	const std::size_t count = 100000;
+
+	// The same entities made directly and through a command buffer
+	BenchScene direct;
+	std::vector<FCS::EntityId> ids;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		auto ent = direct.instantiate();
+		ent->addComponent<Position>()->x = static_cast<float>(i);
+		if (i % 2) ent->addComponent<Velocity>()->y = 1.0f;
+		ids.push_back(ent->getId());
+	}
+
+	BenchScene deferred;
+	FCS::CommandBuffer commands;
+	double record = nsPerOp(1, [&](std::size_t)
+	{
+		for (std::size_t i = 0; i < count; i++)
+		{
+			FCS::EntityId id = commands.instantiate();
+			commands.addComponent<Position>(id).x = static_cast<float>(i);
+			if (i % 2) commands.addComponent<Velocity>(id).y = 1.0f;
+		}
+	}) / count;
+	double play = nsPerOp(1, [&](std::size_t) { deferred.playback(commands); }) / count;
+	check(sameEntities(direct, deferred), "command playback creates the entities made directly");
+
+	for (std::size_t i = 0; i < count; i += 3)
+	{
+		direct.destroy(ids[i]);
+		commands.destroy(ids[i]);
+	}
+	deferred.playback(commands);
+	check(sameEntities(direct, deferred), "command playback destroys the entities destroyed directly");
+
+	std::cout << "Record " << count << " creations in a CommandBuffer: " << record << " ns/entity" << std::endl;
+	std::cout << "Play back " << count << " creations:              " << play << " ns/entity" << std::endl;
+}
+
+// Order the systems below enter and leave their update in, by system
+static std::atomic<int> scheduleClock{ 0 };
+static std::atomic<int> scheduleEnter[16];
+static std::atomic<int> scheduleExit[16];
+
+template<int N, FCS::Phase P, int Priority, typename... Declared>
+class Scheduled : public FCS::System<Declared...>
+{
+public:
+	FCS_SYSTEM_ORDER(P, Priority);
+
+	void initialize(FCS::Scene* /*scene*/) override { }
+	void deinitialize(FCS::Scene* /*scene*/) override { }
+
+	// Long enough for systems running side by side to overlap
+	void update(FCS::Scene* /*scene*/, float /*deltaTime*/) override
+	{
+		scheduleEnter[N] = scheduleClock++;
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+		scheduleExit[N] = scheduleClock++;
+	}
+};
+
+// Whether system a left its update before system b entered its own
+static bool ranBefore(int a, int b)
+{
+	return scheduleExit[a] >= 0 && scheduleEnter[b] >= 0 && scheduleExit[a] < scheduleEnter[b];
+}
+
+// One fixed step of the scene on top of SceneManager per call, stamps reset before it
+static void stepScheduled()
+{
+	for (int i = 0; i < 16; i++)
+	{
+		scheduleEnter[i] = -1;
+		scheduleExit[i] = -1;
+	}
+	FCS::SceneManager::Tick();
+}
+
+// A writer, two readers then a writer of the same component: the readers may run side by side, never with a writer
+using FirstWriter = Scheduled<0, FCS::Phase::Update, 0, FCS::Write<Position>>;
+using FirstReader = Scheduled<1, FCS::Phase::Update, 1, FCS::Read<Position>>;
+using SecondReader = Scheduled<2, FCS::Phase::Update, 1, FCS::Read<Position>>;
+using LastWriter = Scheduled<3, FCS::Phase::Update, 2, FCS::Write<Position>>;
+
+class ConflictScene : public FCS::Scene
+{
+public:
+	void initialize() override
+	{
+		createSystem<LastWriter>();
+		createSystem<SecondReader>();
+		createSystem<FirstReader>();
+		createSystem<FirstWriter>();
+	}
+	void deinitialize() override { }
+};
+
+// Phases come first, then Before/After constraints, then priorities
+using Early = Scheduled<4, FCS::Phase::PreUpdate, 100>;
+using Anchor = Scheduled<5, FCS::Phase::Update, 5>;
+using Ahead = Scheduled<6, FCS::Phase::Update, 10, FCS::Before<Anchor>>;
+using Behind = Scheduled<7, FCS::Phase::Update, 0, FCS::After<Anchor>>;
+using Late = Scheduled<8, FCS::Phase::PostUpdate, -100>;
+
+class OrderedScene : public FCS::Scene
+{
+public:
+	void initialize() override
+	{
+		createSystem<Late>();
+		createSystem<Behind>();
+		createSystem<Anchor>();
+		createSystem<Early>();
+		createSystem<Ahead>();
+	}
+	void deinitialize() override { }
+};
+
+static void benchSchedule()
+{
+	const std::size_t steps = 20;
+
+	// Tiny steps, one per tick
+	FCS::LoopSettings previous = FCS::SceneManager::GetLoopSettings();
+	FCS::LoopSettings settings;
+	settings.fixedStep = 1e-9;
+	settings.maxSteps = 1;
+	FCS::SceneManager::SetLoopSettings(settings);
+
+	std::size_t sideBySide = 0;
+	FCS::SceneManager::LoadScene<ConflictScene>();
+	FCS::SceneManager::Tick();
+	for (std::size_t i = 0; i < steps; i++)
+	{
+		stepScheduled();
+		check(ranBefore(0, 1) && ranBefore(0, 2) && ranBefore(1, 3) && ranBefore(2, 3), "systems writing a component run apart from the ones reading it");
+		sideBySide += !ranBefore(1, 2) && !ranBefore(2, 1);
+	}
+	FCS::SceneManager::UnloadScene();
+
+	FCS::SceneManager::LoadScene<OrderedScene>();
+	for (std::size_t i = 0; i < steps; i++)
+	{
+		stepScheduled();
+		check(ranBefore(4, 6) && ranBefore(6, 5) && ranBefore(5, 7) && ranBefore(7, 8), "systems run by phase, then constraints, then priority");
+	}
+	FCS::SceneManager::UnloadScene();
+
+	FCS::SceneManager::SetLoopSettings(previous);
+	std::cout << "Schedule of " << steps << " updates checked, readers side by side in " << sideBySide << std::endl;
+}
+
+static void benchSnapshot()
+{
+	const std::size_t count = 1000000;
+	const char* path = "bench_snapshot.bin";
+
+	BenchScene scene;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		auto ent = scene.instantiate();
+		ent->addComponent<Position>()->x = static_cast<float>(i);
+		if (i % 2) ent->addComponent<Velocity>()->y = 1.0f;
+	}
+
+	bool saved = false;
+	bool loaded = false;
+	double save = nsPerOp(1, [&](std::size_t) { saved = scene.saveSnapshot(path); }) / 1e6;
+
+	BenchScene copy;
+	double load = nsPerOp(1, [&](std::size_t) { loaded = copy.loadSnapshot(path); }) / 1e6;
+	std::remove(path);
+	check(saved && loaded && sameEntities(scene, copy), "a loaded snapshot holds the entities saved");
+
+	std::cout << "Save snapshot of " << count << " entities: " << save << " ms" << (saved ? "" : " (failed)") << std::endl;
+	std::cout << "Load snapshot of " << count << " entities: " << load << " ms" << (loaded ? "" : " (failed)") << std::endl;
+}
+
+static void benchState()
+{
+	const std::size_t count = 100000;
+
+	BenchScene scene;
+	std::vector<FCS::EntityId> ids;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		auto ent = scene.instantiate();
+		ent->addComponent<Position>()->x = static_cast<float>(i);
+		ent->addComponent<Velocity>()->x = 1.0f;
+		ids.push_back(ent->getId());
+	}
+
+	FCS::SceneState state;
+	double full = nsPerOp(20, [&](std::size_t) { scene.saveState(state, false); }) / 1e3;
+	double clean = nsPerOp(20, [&](std::size_t) { scene.saveState(state); }) / 1e3;
+
+	// A few entities written per frame, each call saves the frame before
+	std::size_t step = 0;
+	double sparse = nsPerOp(20, [&](std::size_t)
+	{
+		for (std::size_t i = 0; i < 100; i++)
+		{
+			scene.getEntity(ids[(step++ * 7919) % count])->getComponent<Position>()->x += 1.0f;
+		}
+		scene.saveState(state);
+	}) / 1e3;
+
+	double everything = nsPerOp(20, [&](std::size_t)
+	{
+		scene.each<Position, Velocity>([](Position& p, const Velocity& v) { p.x += v.x; });
+		scene.saveState(state);
+	}) / 1e3;
+
+	double restoreFull = nsPerOp(20, [&](std::size_t) { scene.restoreState(state, false); }) / 1e3;
+
+	// Rollback of a frame that moved everyone
+	double rollback = nsPerOp(20, [&](std::size_t)
+	{
+		scene.each<Position, Velocity>([](Position& p, const Velocity& v) { p.x += v.x; });
+		scene.restoreState(state);
+	}) / 1e3;
+
+	// Restores undo moves, creations, destructions and component changes, full and dirty saves alike
+	BenchScene rolled;
+	BenchScene kept;
+	std::vector<FCS::EntityId> rolledIds;
+	for (BenchScene* target : { &rolled, &kept })
+	{
+		for (std::size_t i = 0; i < count / 10; i++)
+		{
+			auto ent = target->instantiate();
+			ent->addComponent<Position>()->x = static_cast<float>(i);
+			if (i % 2) ent->addComponent<Velocity>()->x = 1.0f;
+			if (target == &rolled) rolledIds.push_back(ent->getId());
+		}
+	}
+
+	FCS::SceneState saved;
+	for (bool dirtyOnly : { false, true })
+	{
+		rolled.saveState(saved, dirtyOnly);
+		rolled.each<Position, Velocity>([](Position& p, const Velocity& v) { p.x += v.x; });
+		for (std::size_t i = 0; i < 100; i++)
+		{
+			FCS::EntityId id = rolledIds[i * 17];
+			if (i % 3 == 0) rolled.destroy(id);
+			else if (i % 3 == 1) rolled.getEntity(id)->addComponent<Velocity>()->z = 2.0f;
+			else rolled.getEntity(id)->removeComponent<Velocity>();
+			rolled.instantiate()->addComponent<Position>()->y = 3.0f;
+		}
+		check(rolled.restoreState(saved, dirtyOnly) && sameEntities(rolled, kept), "a restored state holds the entities saved");
+	}
+
+	std::cout << "Save state of " << count << " entities, full:                " << full << " us" << std::endl;
+	std::cout << "Save state of " << count << " entities, dirty, nothing written: " << clean << " us" << std::endl;
+	std::cout << "Save state of " << count << " entities, dirty, 100 written:     " << sparse << " us" << std::endl;
+	std::cout << "Save state of " << count << " entities, dirty, each over all:   " << everything << " us (each included)" << std::endl;
+	std::cout << "Restore state of " << count << " entities, full:             " << restoreFull << " us" << std::endl;
+	std::cout << "Restore state of " << count << " entities, dirty, each over all: " << rollback << " us (each included)" << std::endl;
+}
+
+static void benchDelta()
+{
+	const std::size_t count = 100000;
+
+	BenchScene server;
+	BenchScene client;
+	std::vector<FCS::EntityId> ids;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		auto ent = server.instantiate();
+		ent->addComponent<Position>()->x = static_cast<float>(i);
+		ent->addComponent<Velocity>()->x = 0.01f;
+		ids.push_back(ent->getId());
+	}
+
+	// Client starts from the full world
+	FCS::SceneState acked;
+	FCS::SceneState current;
+	FCS::SceneState empty;
+	FCS::SnapshotWriter writer;
+	server.saveState(acked);
+	server.encodeDelta(empty, acked, writer);
+	std::size_t fullBytes = writer.bytes().size();
+	check(client.applyDelta(writer.bytes().data(), writer.bytes().size()) && sameEntities(server, client), "a client matches the server after the full world delta");
+
+	// Comparing hands out the components, which counts as writing them
+	server.saveState(acked);
+
+	auto tick = [&](const char* name, auto&& simulate)
+	{
+		simulate();
+		server.saveState(current);
+		writer.clear();
+		double encode = nsPerOp(1, [&](std::size_t) { server.encodeDelta(acked, current, writer); }) / 1e3;
+		bool applied = false;
+		double decode = nsPerOp(1, [&](std::size_t) { applied = client.applyDelta(writer.bytes().data(), writer.bytes().size()); }) / 1e3;
+		check(applied && sameEntities(server, client), "a client matches the server after each delta");
+		server.saveState(acked);
+		std::cout << "Delta of " << count << " entities, " << name << writer.bytes().size() << " bytes, encode " << encode << " us, apply " << decode << " us" << std::endl;
+	};
+
+	std::cout << "Delta of " << count << " entities, full world:     " << fullBytes << " bytes" << std::endl;
+	tick("nothing written: ", [] { });
+	tick("1% moved:        ", [&]
+	{
+		for (std::size_t i = 0; i < count; i += 100)
+		{
+			server.getEntity(ids[i])->getComponent<Position>()->x += 0.01f;
+		}
+	});
+	tick("all moved:       ", [&] { server.each<Position, Velocity>([](Position& p, const Velocity& v) { p.x += v.x; }); });
+	tick("100 recycled:    ", [&]
+	{
+		for (std::size_t i = 0; i < count; i += count / 100)
+		{
+			server.destroy(ids[i]);
+			auto ent = server.instantiate();
+			ent->addComponent<Position>()->y = 1.0f;
+			ids[i] = ent->getId();
+		}
+	});
+}
+
+static void benchBMP()
+{
+	using namespace resource_loader::image_bmp;
+
+	// 32 bit rows are never padded, 24 bit ones are when the width is not a multiple of 4
+	const std::uint32_t sizes[][3] = { { 4096, 4096, 4 }, { 4095, 4096, 3 } };
+	const char* path = "bench_image.bmp";
+	for (auto& size : sizes)
+	{
+		// Bytes vary along and across rows, so misplaced ones show
+		Image source = allocateImage(size[0], size[1], size[2]);
+		for (std::size_t i = 0; i < source.size; i++)
+		{
+			source.data[i] = static_cast<resource_loader::byte>(i * 31 + i / 4093);
+		}
+		write32_24BMP(path, &source);
+		deallocateImg(&source);
+
+		Image expected = read32_24BMP(path);
+		Image mapped = map32_24BMP(path);
+		check(expected.data && mapped.data && mapped.size == expected.size && mapped.width == expected.width && mapped.height == expected.height &&
+			mapped.channels == expected.channels && std::memcmp(mapped.data, expected.data, expected.size) == 0, "a mapped BMP holds the bytes read32_24BMP reads");
+		deallocateImg(&mapped);
+
+		std::size_t touched = 0;
+		double read = nsPerOp(5, [&](std::size_t) { Image img = read32_24BMP(path); touched += img.data[img.size - 1]; deallocateImg(&img); }) / 1e6;
+		double map = nsPerOp(5, [&](std::size_t) { Image img = map32_24BMP(path); touched += img.data[img.size - 1]; deallocateImg(&img); }) / 1e6;
+
+		// Bands of 64 rows through the default window
+		std::vector<resource_loader::byte> band(std::size_t(64) * size[0] * size[2]);
+		double stream = nsPerOp(5, [&](std::size_t)
+		{
+			BandReader reader;
+			if (openBands32_24BMP(path, &reader))
+			{
+				while (std::uint32_t rows = readBand(&reader, band.data(), 64))
+				{
+					touched += band[std::size_t(rows) * reader.layout.row_stride - 1];
+				}
+			}
+			closeBands(&reader);
+		}) / 1e6;
+		sink = sink + touched;
+
+		// Bands of 100 rows through an odd window, the last one short, put together match the whole image
+		std::vector<resource_loader::byte> rows;
+		std::uint32_t last = 0;
+		BandReader reader;
+		if (openBands32_24BMP(path, &reader, 1000))
+		{
+			std::vector<resource_loader::byte> part(std::size_t(100) * reader.layout.row_stride);
+			while (std::uint32_t count = readBand(&reader, part.data(), 100))
+			{
+				rows.insert(rows.end(), part.begin(), part.begin() + std::size_t(count) * reader.layout.row_stride);
+				last = count;
+			}
+			check(!reader.failed && last == (size[1] % 100 ? size[1] % 100 : 100), "the last band holds the rows left");
+		}
+		closeBands(&reader);
+		check(expected.data && rows.size() == expected.size && std::memcmp(rows.data(), expected.data, expected.size) == 0, "bands hold the bytes read32_24BMP reads");
+		deallocateImg(&expected);
+
+		std::cout << "Load " << size[0] << "x" << size[1] << "x" << size[2] << " BMP, read: " << read << " ms, mapped: " << map << " ms, "
+			<< "64 row bands: " << stream << " ms (" << band.size() / 1024 << " KB band)" << std::endl;
+	}
+	std::remove(path);
+}
+
+int main()
+{
+	benchTypeLookup(std::make_integer_sequence<int, 8>());
+	benchEntityLookup();
+	benchIteration();
+	benchUnload();
+	benchEvents();
+	benchCommands();
+	benchSchedule();
+	benchSnapshot();
+	benchState();
+	benchDelta();
+	benchBMP();
+	return failed ? 1 : 0;
+}
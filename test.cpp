@@ -31,7 +31,7 @@ public:
 
 	void onEvent(FCS::Scene* scene, const FCS::Event::EntityCreated& event)
 	{
-		std::cout << "Entity " << typeid(event.entity).name() << " was created!" << std::endl;
+		std::cout << "Entity " << event.entity.getId().index << " was created!" << std::endl;
 	}
 };
 
@@ -71,10 +71,9 @@ int main(int argc, char* argv[])
 	glUseProgram(p);
 	glDeleteProgram(p);
 
-	while (true)
-	{
-
-	}
+	// Paced fixed step loop instead of spinning, runs until SceneManager::Stop()
+	FCS::SceneManager::LoadScene<MyScene>();
+	FCS::SceneManager::Run();
 
 	return 0;
 }
\ No newline at end of file